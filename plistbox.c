@@ -18,6 +18,7 @@
 #include <glib.h>
 #include <glib-object.h>
 #include <gtk/gtk.h>
+#include <gtk/gtk-a11y.h>
 #include <gdk/gdk.h>
 #include <float.h>
 #include <math.h>
@@ -27,6 +28,12 @@
 
 #include "plistbox.h"
 
+/* Tiles are rendered at the scale factor of the window where GTK and
+   cairo support it */
+#if GTK_CHECK_VERSION (3, 10, 0) && CAIRO_VERSION >= CAIRO_VERSION_ENCODE (1, 14, 0)
+#define HAVE_TILE_SCALE 1
+#endif
+
 /* This already exists in gtk as _gtk_marshal_VOID__ENUM_INT, inline it here for now
    to avoid separate marshallers file */
 static void
@@ -56,12 +63,28 @@ _p_marshal_VOID__ENUM_INT (GClosure * closure,
 }
 
 typedef struct _PListBoxChildInfo PListBoxChildInfo;
+typedef struct _PListBoxFeedItem PListBoxFeedItem;
+typedef struct _PListBoxTile PListBoxTile;
+typedef struct _PListBoxRenderJob PListBoxRenderJob;
+typedef struct _PListBoxRenderTarget PListBoxRenderTarget;
+typedef struct _PListBoxSearchEntry PListBoxSearchEntry;
+typedef struct _PListBoxRowAnimation PListBoxRowAnimation;
 
 struct _PListBoxPrivate
 {
   GSequence *children;
-  GHashTable *child_hash;
-  GHashTable *separator_hash;
+  guint serial;
+
+  /* Row geometry and flags in sequence order, indexed by info->index.
+     Layout, hit testing and culling only scan these. */
+  PListBoxChildInfo **row_info;
+  gint *row_y;
+  gint *row_height;
+  gint *row_separator_height;
+  guint8 *row_flags;
+  guint n_rows;
+  guint rows_capacity;
+  gboolean rows_dirty;
 
   PListBoxSortFunc sort_func;
   gpointer sort_func_target;
@@ -90,6 +113,216 @@ struct _PListBoxPrivate
   /* DnD */
   GtkWidget *drag_highlighted_widget;
   guint auto_scroll_timeout_id;
+
+  /* Row recycling, row type quark -> GQueue of parked widgets */
+  GHashTable *recycle_pool;
+  guint recycle_limit;
+
+  /* Some rows outside the viewport were not allocated in the last pass */
+  gboolean has_stale_rows;
+
+  /* Width changes. Rows out of view keep their height until reflow_id
+     gets to them, reflow_width is the width the others have. */
+  gint reflow_width;
+  gboolean reflow_pending;
+  guint reflow_id;
+
+  /* Sections, runs of visible rows with the same section name. As of
+     the last allocation, section_info holds the first row of each and
+     section_y where its header starts. Headers are kept up to date
+     along with the separators, keyed by the first row of their
+     section, but only the ones from header_first to header_last, near
+     the view, are allocated and drawn. The header of the section at
+     the top of the view is pinned there. */
+  PListBoxCreateHeaderFunc create_header_func;
+  gpointer create_header_func_target;
+  GDestroyNotify create_header_func_target_destroy_notify;
+  PListBoxChildInfo **section_info;
+  gint *section_y;
+  guint n_sections;
+  gint header_height;
+  GHashTable *headers;
+  guint header_first;
+  guint header_last;
+  PListBoxChildInfo *pinned_section;
+  gint pinned_y;
+
+  /* Type-ahead. search_index holds a PListBoxSearchEntry for each row
+     that has a search key, sorted by the folded key. It is built on the
+     first keystroke, search_indexed is set from then on and the index
+     is kept up to date as rows come, go and change. */
+  PListBoxSearchKeyFunc search_key_func;
+  gpointer search_key_func_target;
+  GDestroyNotify search_key_func_target_destroy_notify;
+  GSequence *search_index;
+  gboolean search_indexed;
+  GString *search_text;
+  guint search_timeout_id;
+
+  /* Columns. column_counts holds, per column, how many rows reported
+     each width, so column_max can be kept up to date as rows come, go
+     and change. columns_serial goes up whenever a maximum changes, rows
+     with an older serial are handed the new widths on allocation. */
+  guint n_columns;
+  gint *column_max;
+  GHashTable **column_counts;
+  guint columns_serial;
+  PListBoxUpdateColumnsFunc update_columns_func;
+  gpointer update_columns_func_target;
+  GDestroyNotify update_columns_func_target_destroy_notify;
+
+  /* Tree mode. A row's descendants follow it in children while it is
+     expanded, and are moved into its collapsed sequence otherwise. */
+  PListBoxLoadChildrenFunc load_children_func;
+  gpointer load_children_func_target;
+  GDestroyNotify load_children_func_target_destroy_notify;
+  gboolean has_tree;
+
+  /* Grid mode. Visible rows are laid out in bands of grid_columns
+     equally sized tiles. grid_rows maps a tile's ordinal among the
+     visible rows to its row, grid_ordinal maps back, both as of the
+     last allocation. */
+  PListBoxLayoutMode layout_mode;
+  gint grid_item_width;
+  gint grid_item_height;
+  guint grid_columns;
+  gint grid_band_height;
+  guint *grid_rows;
+  guint *grid_ordinal;
+  guint n_grid;
+
+  /* Draw-only rows */
+  PListBoxCellFuncs cell_funcs;
+  gpointer cell_funcs_target;
+  PListBoxRenderTarget *cell_funcs_holder;
+  GDestroyNotify cell_data_destroy_notify;
+  PListBoxCellSortFunc cell_sort_func;
+  gpointer cell_sort_func_target;
+  GDestroyNotify cell_sort_func_target_destroy_notify;
+
+  /* Cells rendered into image surfaces on worker threads. Finished
+     jobs are handed back through render_done, under render_lock. */
+  GThreadPool *render_pool;
+  GMutex render_lock;
+  GSList *render_done;
+  guint render_idle_id;
+  guint render_jobs;
+  GQueue *tiles;
+  guint tile_limit;
+  gdouble last_scroll_value;
+
+  /* Accessibility, info -> PListBoxCellAccessible for cells a client
+     asked about that are still near the view */
+  AtkObject *accessible;
+  GHashTable *cell_accessibles;
+  /* Rows that came or went since the last notification, see
+     p_list_box_accessible_row_changed() */
+  GArray *a11y_changes;
+  guint a11y_idle_id;
+
+  /* Rows pushed from other threads. feed_head is a lock-free LIFO
+     written by the producers; feed_pending is the FIFO backlog the
+     main thread has already taken over but not yet turned into rows. */
+  PListBoxCreateChildFunc create_child_func;
+  gpointer create_child_func_target;
+  GDestroyNotify create_child_func_target_destroy_notify;
+  GDestroyNotify item_destroy_notify;
+  PListBoxFeedItem *feed_head;
+  PListBoxFeedItem *feed_pending;
+  PListBoxFeedItem *feed_pending_tail;
+  gint feed_scheduled;
+  guint feed_tick_id;
+  guint feed_budget;
+
+  /* Row animations, one tick for all of them. The allocation lays the
+     rows out at their full height and keeps row_y in anim_base_y and
+     section_y in anim_section_y, each frame only moves the rows by
+     the animated heights above them. animations is sorted by index
+     while anim_laid_out is set. */
+  GPtrArray *animations;
+  guint animation_duration;
+  guint animation_tick_id;
+  gboolean anim_laid_out;
+  gint *anim_base_y;
+  gint *anim_section_y;
+  gint anim_end_y;
+};
+
+/* Rendering state of a cell, only allocated once it was drawn */
+struct _PListBoxTile
+{
+  cairo_surface_t *surface;
+  gint width;
+  gint height;
+  gint scale;
+  /* Link in priv->tiles while surface is set, most recently drawn first */
+  GList *link;
+  PListBoxRenderJob *job;
+  guint generation;
+};
+
+struct _PListBoxRenderJob
+{
+  /* Set up on the main thread, read only by the worker */
+  PListBox *list_box;
+  PListBoxCellRenderFunc render;
+  PListBoxRenderTarget *render_target;
+  gpointer cell_data;
+  gint width;
+  gint height;
+  gint scale;
+  guint generation;
+  /* Copy of the column widths, see p_list_box_get_column_width() */
+  gint *column_widths;
+  guint n_columns;
+  guint columns_serial;
+
+  /* Written by the worker */
+  cairo_surface_t *surface;
+
+  /* Main thread only. info is cleared if the cell goes away meanwhile,
+     and cell_data is then freed once the job is back. */
+  PListBoxChildInfo *info;
+  GDestroyNotify free_cell_data;
+};
+
+/* The target of the cell funcs, kept alive by the render jobs that
+   still use it after the funcs were replaced. Main thread only. */
+struct _PListBoxRenderTarget
+{
+  guint ref_count;
+  gpointer target;
+  GDestroyNotify target_destroy_notify;
+};
+
+struct _PListBoxSearchEntry
+{
+  gchar *key;
+  PListBoxChildInfo *info;
+};
+
+/* A row growing in, or the snapshot of a removed row collapsing in
+   front of before, NULL for the end of the list */
+struct _PListBoxRowAnimation
+{
+  PListBoxChildInfo *info;
+  PListBoxChildInfo *before;
+  cairo_surface_t *surface;
+  /* Full height, for snapshots including the separator */
+  gint height;
+  gint64 start_time;
+  gdouble progress;
+  /* Position in the row arrays as of the last allocation */
+  guint index;
+  /* Where the snapshot is drawn, and how much of it */
+  gint y;
+  gint visible_height;
+};
+
+struct _PListBoxFeedItem
+{
+  PListBoxFeedItem *next;
+  gpointer item;
 };
 
 struct _PListBoxChildInfo
@@ -97,8 +330,42 @@ struct _PListBoxChildInfo
   GSequenceIter *iter;
   GtkWidget *widget;
   GtkWidget *separator;
-  gint y;
-  gint height;
+  GQuark row_type;
+  GQuark section;
+  /* Entry in priv->search_index, if the row has a search key */
+  GSequenceIter *search_iter;
+  /* Widths the row needs for each column, NULL if it did not say */
+  gint *column_widths;
+  guint columns_serial;
+
+  /* Tree mode */
+  PListBoxChildInfo *parent_row;
+  /* Most recently added child, new children without a sort function
+     go after its subtree */
+  PListBoxChildInfo *last_child;
+  /* Descendants while collapsed, in order */
+  GSequence *collapsed;
+  guint depth;
+  guint expanded : 1;
+  guint children_loaded : 1;
+  /* Order the row was added in, for rows that sort the same */
+  guint serial;
+  /* Position in the row arrays, see p_list_box_ensure_rows() */
+  guint index;
+  /* Visibility of the widget as last seen by p_list_box_child_visibility_changed() */
+  guint visible : 1;
+  /* The widget or one inside it has a GdkWindow, so the row is never
+     left unallocated */
+  guint has_windows : 1;
+
+  /* Draw-only rows have no widget, just data for the cell funcs */
+  gpointer cell_data;
+  gint cell_width;
+  gint cell_height;
+  PListBoxTile *tile;
+
+  /* Set while the row is growing in */
+  PListBoxRowAnimation *animation;
 };
 
 enum {
@@ -108,6 +375,8 @@ enum {
   TOGGLE_CURSOR_CHILD,
   MOVE_CURSOR,
   REFILTER,
+  CELL_SELECTED,
+  CELL_ACTIVATED,
   LAST_SIGNAL
 };
 
@@ -115,12 +384,14 @@ enum  {
   PROP_0,
   PROP_SELECTION_MODE,
   PROP_ACTIVATE_ON_SINGLE_CLICK,
+  PROP_LAYOUT_MODE,
   LAST_PROPERTY
 };
 
 G_DEFINE_TYPE (PListBox, p_list_box, GTK_TYPE_CONTAINER)
 
-static PListBoxChildInfo *p_list_box_find_child_at_y              (PListBox          *list_box,
+static PListBoxChildInfo *p_list_box_find_child_at                (PListBox          *list_box,
+								       gint                 x,
 								       gint                 y);
 static PListBoxChildInfo *p_list_box_lookup_info                  (PListBox          *list_box,
 								       GtkWidget           *widget);
@@ -156,6 +427,8 @@ static gboolean             p_list_box_real_button_press_event      (GtkWidget
 								       GdkEventButton      *event);
 static gboolean             p_list_box_real_button_release_event    (GtkWidget           *widget,
 								       GdkEventButton      *event);
+static gboolean             p_list_box_real_key_press_event         (GtkWidget           *widget,
+								       GdkEventKey         *event);
 static void                 p_list_box_real_show                    (GtkWidget           *widget);
 static gboolean             p_list_box_real_focus                   (GtkWidget           *widget,
 								       GtkDirectionType     direction);
@@ -166,6 +439,7 @@ static PListBoxChildInfo *p_list_box_get_last_visible             (PListBox
 static gboolean             p_list_box_real_draw                    (GtkWidget           *widget,
 								       cairo_t             *cr);
 static void                 p_list_box_real_realize                 (GtkWidget           *widget);
+static void                 p_list_box_real_unrealize               (GtkWidget           *widget);
 static void                 p_list_box_real_add                     (GtkContainer        *container,
 								       GtkWidget           *widget);
 static void                 p_list_box_real_remove                  (GtkContainer        *container,
@@ -196,6 +470,90 @@ static void                 p_list_box_real_move_cursor             (PListBox
 								       gint                 count);
 static void                 p_list_box_real_refilter                (PListBox          *list_box);
 static void                 p_list_box_finalize                     (GObject             *obj);
+static void                 p_list_box_feed_free_items              (PListBox          *list_box);
+static void                 p_list_box_adjustment_changed           (GtkAdjustment       *adjustment,
+								       PListBox          *list_box);
+static gboolean             p_list_box_widget_has_windows           (GtkWidget         *widget);
+static gint                 p_list_box_get_focus_size               (PListBox          *list_box);
+static gint                 p_list_box_measure_cell                 (PListBox          *list_box,
+								       PListBoxChildInfo *info,
+								       gint                 width);
+static void                 p_list_box_render_target_unref          (PListBoxRenderTarget *holder);
+static void                 p_list_box_tile_free                    (PListBoxTile      *tile);
+static gboolean             p_list_box_drop_tile                    (PListBox          *list_box,
+								       PListBoxChildInfo *info);
+static gboolean             p_list_box_draw_tile                    (PListBox          *list_box,
+								       PListBoxChildInfo *info,
+								       cairo_t             *cr,
+								       gint                 width,
+								       gint                 height);
+static void                 p_list_box_prefetch_tiles               (PListBox          *list_box);
+static gboolean             p_list_box_get_view_range               (PListBox          *list_box,
+								       GtkAllocation       *allocation,
+								       gint                *view_start,
+								       gint                *view_end);
+static void                 p_list_box_drop_header                  (PListBox          *list_box,
+								       PListBoxChildInfo *info);
+static gint                 p_list_box_get_header_height            (PListBox          *list_box,
+								       gint                 width);
+static void                 p_list_box_update_headers               (PListBox          *list_box);
+static void                 p_list_box_update_header                (PListBox          *list_box,
+								       GSequenceIter     *iter);
+static void                 p_list_box_search_entry_free            (PListBoxSearchEntry *entry);
+static void                 p_list_box_index_row                    (PListBox          *list_box,
+								       PListBoxChildInfo *info);
+static void                 p_list_box_unindex_row                  (PListBox          *list_box,
+								       PListBoxChildInfo *info);
+static void                 p_list_box_reindex                      (PListBox          *list_box);
+static void                 p_list_box_set_row_columns              (PListBox          *list_box,
+								       PListBoxChildInfo *info,
+								       const gint          *widths);
+static void                 p_list_box_free_columns                 (PListBox          *list_box);
+static GSequenceIter *      p_list_box_get_subtree_end              (PListBoxChildInfo *info);
+static void                 p_list_box_remove_descendants           (PListBox          *list_box,
+								       PListBoxChildInfo *info);
+static void                 p_list_box_unlink_tree_row              (PListBox          *list_box,
+								       PListBoxChildInfo *info);
+static void                 p_list_box_expand_row                   (PListBox          *list_box,
+								       PListBoxChildInfo *info);
+static void                 p_list_box_collapse_row                 (PListBox          *list_box,
+								       PListBoxChildInfo *info);
+static void                 p_list_box_get_row_span                 (PListBox          *list_box,
+								       guint                i,
+								       gint                 width,
+								       gint                *x,
+								       gint                *row_width);
+static PListBoxChildInfo *p_list_box_grid_offset                  (PListBox          *list_box,
+								       PListBoxChildInfo *info,
+								       gint                 delta);
+static void                 p_list_box_allocate_row                 (PListBox          *list_box,
+								       guint                i,
+								       gint                 width,
+								       gint                 focus);
+static void                 p_list_box_allocate_grid                (PListBox          *list_box,
+								       GtkAllocation       *allocation);
+static void                 p_list_box_get_grid_item_size           (PListBox          *list_box,
+								       gint                *width,
+								       gint                *height);
+static guint                p_list_box_get_grid_columns             (gint                 width,
+								       gint                 item_width);
+static gboolean             p_list_box_cell_hit_test                (PListBox          *list_box,
+								       PListBoxChildInfo *info,
+								       gint                 x,
+								       gint                 y);
+static void                 p_list_box_row_animation_free           (PListBoxRowAnimation *animation);
+static void                 p_list_box_animate_insertion            (PListBox          *list_box,
+								       PListBoxChildInfo *info);
+static void                 p_list_box_animate_removal              (PListBox          *list_box,
+								       PListBoxChildInfo *info);
+static void                 p_list_box_forget_row_animation         (PListBox          *list_box,
+								       PListBoxChildInfo *info);
+static void                 p_list_box_draw_animated_row            (PListBox          *list_box,
+								       PListBoxChildInfo *info,
+								       cairo_t             *cr,
+								       GtkStateFlags        state,
+								       gint                 width,
+								       gint                 focus);
 
 
 static void                 p_list_box_real_get_preferred_height           (GtkWidget           *widget,
@@ -215,14 +573,89 @@ static void                 p_list_box_real_get_preferred_width_for_height (GtkW
 
 static GParamSpec *properties[LAST_PROPERTY] = { NULL, };
 static guint signals[LAST_SIGNAL] = { 0 };
+/* Rows and separators point back at their child info with this */
+static GQuark child_info_quark;
+/* Section headers point at the first row of their section with this */
+static GQuark header_quark;
+
+/* row_flags */
+enum {
+  ROW_VISIBLE = 1 << 0,
+  /* Geometry is up to date but the widget has not been moved there yet */
+  ROW_ALLOC_STALE = 1 << 1,
+  /* The height is from before the width last changed */
+  ROW_HEIGHT_STALE = 1 << 2
+};
+
+/* Maximum number of parked rows kept per row type */
+#define DEFAULT_RECYCLE_LIMIT 256
+/* Time in microseconds spent turning pushed items into rows per frame */
+#define DEFAULT_FEED_BUDGET 4000
+/* Number of rendered cell tiles kept around */
+#define DEFAULT_TILE_LIMIT 512
+/* Time in milliseconds after which typed text starts a new search */
+#define SEARCH_TIMEOUT 1000
+/* Time in milliseconds the width has to stay the same before rows
+   out of view are measured again */
+#define REFLOW_DELAY 150
+/* Time in microseconds spent measuring rows out of view per idle */
+#define REFLOW_BUDGET 8000
+/* Number of rows that animate at the same time, more just show up */
+#define MAX_ROW_ANIMATIONS 64
+
+static void
+recycle_queue_free (GQueue *queue)
+{
+  g_queue_free_full (queue, g_object_unref);
+}
+
+static void
+p_list_box_find_window (GtkWidget *widget, gpointer user_data)
+{
+  gboolean *found = user_data;
+
+  if (!*found)
+    *found = p_list_box_widget_has_windows (widget);
+}
+
+/* Looked at when a row is added or changed, a row whose windows
+   were left where they last were would show up there */
+static gboolean
+p_list_box_widget_has_windows (GtkWidget *widget)
+{
+  gboolean found;
+
+  if (gtk_widget_get_has_window (widget))
+    return TRUE;
+
+  found = FALSE;
+  if (GTK_IS_CONTAINER (widget))
+    gtk_container_forall (GTK_CONTAINER (widget), p_list_box_find_window, &found);
+  return found;
+}
 
 static PListBoxChildInfo*
-p_list_box_child_info_new (GtkWidget *widget)
+p_list_box_child_info_new (GtkWidget *widget, guint serial)
 {
   PListBoxChildInfo *info;
 
-  info = g_new0 (PListBoxChildInfo, 1);
+  info = g_slice_new0 (PListBoxChildInfo);
   info->widget = g_object_ref (widget);
+  info->serial = serial;
+  info->index = G_MAXUINT;
+  return info;
+}
+
+static PListBoxChildInfo*
+p_list_box_cell_info_new (gpointer cell_data, guint serial)
+{
+  PListBoxChildInfo *info;
+
+  info = g_slice_new0 (PListBoxChildInfo);
+  info->index = G_MAXUINT;
+  info->cell_data = cell_data;
+  info->serial = serial;
+  info->cell_width = -1;
   return info;
 }
 
@@ -231,128 +664,743 @@ p_list_box_child_info_free (PListBoxChildInfo *info)
 {
   g_clear_object (&info->widget);
   g_clear_object (&info->separator);
-  g_free (info);
+  g_free (info->column_widths);
+  if (info->collapsed != NULL)
+    g_sequence_free (info->collapsed);
+  g_slice_free (PListBoxChildInfo, info);
 }
 
-GtkWidget *
-p_list_box_new (void)
+/* Makes room for n rows in the row arrays. They grow by doubling and
+   give memory back once they are mostly empty, so rebuilding them
+   does not allocate as rows come and go. */
+static void
+p_list_box_reserve_rows (PListBoxPrivate *priv, guint n)
 {
-  return g_object_new (P_TYPE_LIST_BOX, NULL);
+  guint capacity;
+
+  if (n <= priv->rows_capacity && n >= priv->rows_capacity / 4)
+    return;
+
+  capacity = MAX (n, 16);
+  if (n > priv->rows_capacity)
+    capacity = MAX (capacity, priv->rows_capacity * 2);
+  if (capacity == priv->rows_capacity)
+    return;
+
+  priv->row_info = g_renew (PListBoxChildInfo *, priv->row_info, capacity);
+  priv->row_y = g_renew (gint, priv->row_y, capacity);
+  priv->row_height = g_renew (gint, priv->row_height, capacity);
+  priv->row_separator_height = g_renew (gint, priv->row_separator_height, capacity);
+  priv->row_flags = g_renew (guint8, priv->row_flags, capacity);
+  priv->rows_capacity = capacity;
 }
 
 static void
-p_list_box_init (PListBox *list_box)
+p_list_box_move_row (PListBoxPrivate *priv, guint from, guint to)
 {
-  PListBoxPrivate *priv;
+  priv->row_y[to] = priv->row_y[from];
+  priv->row_height[to] = priv->row_height[from];
+  priv->row_separator_height[to] = priv->row_separator_height[from];
+  priv->row_flags[to] = priv->row_flags[from];
+}
 
-  list_box->priv = priv =
-    G_TYPE_INSTANCE_GET_PRIVATE (list_box, P_TYPE_LIST_BOX, PListBoxPrivate);
+/* Renumbers the rows after the sequence changed. Rows keep their
+   geometry from the last layout, new rows start out empty.
 
-  gtk_widget_set_can_focus (GTK_WIDGET (list_box), TRUE);
-  gtk_widget_set_has_window (GTK_WIDGET (list_box), TRUE);
-  gtk_widget_set_redraw_on_allocate (GTK_WIDGET (list_box), TRUE);
-  priv->selection_mode = GTK_SELECTION_SINGLE;
-  priv->activate_single_click = TRUE;
+   The arrays are updated in place. As long as the rows that stay keep
+   their order, which is all but a resort, rows moving up are moved
+   front to back and rows moving down back to front, and none
+   overwrites one that is still to be moved. A resort copies the old
+   geometry aside first. */
+static void
+p_list_box_ensure_rows (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info;
+  GSequenceIter *iter;
+  gint *old_y, *old_height, *old_separator_height;
+  guint8 *old_flags;
+  gboolean ordered;
+  guint n, i, old, last;
+  gint end;
 
-  priv->children = g_sequence_new ((GDestroyNotify)p_list_box_child_info_free);
-  priv->child_hash = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, NULL);
-  priv->separator_hash = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, NULL);
+  if (!priv->rows_dirty)
+    return;
+
+  /* Forget the rows that are new here, and see whether the others
+     are still in order */
+  ordered = TRUE;
+  last = 0;
+  for (iter = g_sequence_get_begin_iter (priv->children), i = 0;
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter), i++)
+    {
+      info = g_sequence_get (iter);
+      old = info->index;
+      if (old >= priv->n_rows || priv->row_info[old] != info)
+	{
+	  info->index = G_MAXUINT;
+	  continue;
+	}
+      if (old < last)
+	ordered = FALSE;
+      last = old + 1;
+    }
+
+  n = i;
+  p_list_box_reserve_rows (priv, MAX (n, priv->n_rows));
+
+  if (ordered)
+    {
+      for (iter = g_sequence_get_begin_iter (priv->children), i = 0;
+	   !g_sequence_iter_is_end (iter);
+	   iter = g_sequence_iter_next (iter), i++)
+	{
+	  old = ((PListBoxChildInfo *) g_sequence_get (iter))->index;
+	  if (old != G_MAXUINT && old > i)
+	    p_list_box_move_row (priv, old, i);
+	}
+      for (iter = g_sequence_get_end_iter (priv->children), i = n;
+	   !g_sequence_iter_is_begin (iter);
+	   i--)
+	{
+	  iter = g_sequence_iter_prev (iter);
+	  old = ((PListBoxChildInfo *) g_sequence_get (iter))->index;
+	  if (old != G_MAXUINT && old < i - 1)
+	    p_list_box_move_row (priv, old, i - 1);
+	}
+    }
+  else
+    {
+      old_y = g_memdup (priv->row_y, priv->n_rows * sizeof (gint));
+      old_height = g_memdup (priv->row_height, priv->n_rows * sizeof (gint));
+      old_separator_height = g_memdup (priv->row_separator_height, priv->n_rows * sizeof (gint));
+      old_flags = g_memdup (priv->row_flags, priv->n_rows * sizeof (guint8));
+      for (iter = g_sequence_get_begin_iter (priv->children), i = 0;
+	   !g_sequence_iter_is_end (iter);
+	   iter = g_sequence_iter_next (iter), i++)
+	{
+	  old = ((PListBoxChildInfo *) g_sequence_get (iter))->index;
+	  if (old == G_MAXUINT)
+	    continue;
+	  priv->row_y[i] = old_y[old];
+	  priv->row_height[i] = old_height[old];
+	  priv->row_separator_height[i] = old_separator_height[old];
+	  priv->row_flags[i] = old_flags[old];
+	}
+      g_free (old_y);
+      g_free (old_height);
+      g_free (old_separator_height);
+      g_free (old_flags);
+    }
+
+  /* New rows, and rows that would end above the row before them after
+     a resort, sit at the end of the row before them with no height,
+     so the row ends stay sorted for p_list_box_bisect_rows() */
+  end = 0;
+  for (iter = g_sequence_get_begin_iter (priv->children), i = 0;
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter), i++)
+    {
+      info = g_sequence_get (iter);
+      if (info->index == G_MAXUINT ||
+	  priv->row_y[i] + priv->row_height[i] < end)
+	{
+	  priv->row_y[i] = end;
+	  priv->row_height[i] = 0;
+	  priv->row_separator_height[i] = 0;
+	  priv->row_flags[i] = 0;
+	}
+      end = priv->row_y[i] + priv->row_height[i];
+      priv->row_info[i] = info;
+      info->index = i;
+    }
+
+  priv->n_rows = n;
+  p_list_box_reserve_rows (priv, n);
+  priv->rows_dirty = FALSE;
+  /* May point at rows that are gone, until the next allocation */
+  priv->n_sections = 0;
+  priv->n_grid = 0;
+  priv->anim_laid_out = FALSE;
+}
+
+static gint
+row_get_y (PListBox *list_box, PListBoxChildInfo *info)
+{
+  p_list_box_ensure_rows (list_box);
+  return list_box->priv->row_y[info->index];
+}
+
+static gint
+row_get_height (PListBox *list_box, PListBoxChildInfo *info)
+{
+  p_list_box_ensure_rows (list_box);
+  return list_box->priv->row_height[info->index];
+}
+
+/* Finds the first row that ends below y. Rows are laid out top to
+   bottom, so the row ends are sorted. */
+static guint
+p_list_box_bisect_rows (PListBox *list_box, gint y)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  guint lo, hi, mid;
+
+  p_list_box_ensure_rows (list_box);
+
+  lo = 0;
+  hi = priv->n_rows;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (priv->row_y[mid] + priv->row_height[mid] <= y)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo;
 }
 
+/* Accessibility. The list reports its rows from its own storage
+   instead of going through GtkContainerAccessible, which tracks every
+   child. Widget rows use their own accessible, which GTK only creates
+   when asked for. Cells get a light accessible of their own, created
+   on demand and dropped again once the cell leaves the view. */
+
+typedef struct
+{
+  GtkWidgetAccessible parent;
+} PListBoxAccessible;
+
+typedef struct
+{
+  GtkWidgetAccessibleClass parent_class;
+} PListBoxAccessibleClass;
+
+typedef struct
+{
+  AtkObject parent;
+  PListBox *list_box;
+  /* NULL once dropped, the object is defunct then */
+  PListBoxChildInfo *info;
+} PListBoxCellAccessible;
+
+typedef struct
+{
+  AtkObjectClass parent_class;
+} PListBoxCellAccessibleClass;
+
+static GType p_list_box_accessible_get_type (void);
+static GType p_list_box_cell_accessible_get_type (void);
+
+G_DEFINE_TYPE (PListBoxAccessible, p_list_box_accessible, GTK_TYPE_WIDGET_ACCESSIBLE)
+G_DEFINE_TYPE (PListBoxCellAccessible, p_list_box_cell_accessible, ATK_TYPE_OBJECT)
+
 static void
-p_list_box_get_property (GObject    *obj,
-                           guint       property_id,
-                           GValue     *value,
-                           GParamSpec *pspec)
+p_list_box_cell_accessible_init (PListBoxCellAccessible *accessible)
 {
-  PListBox *list_box = P_LIST_BOX (obj);
+}
 
-  switch (property_id)
+static gint
+p_list_box_cell_accessible_get_index_in_parent (AtkObject *obj)
+{
+  PListBoxCellAccessible *accessible = (PListBoxCellAccessible *) obj;
+
+  if (accessible->info == NULL)
+    return -1;
+
+  return g_sequence_iter_get_position (accessible->info->iter);
+}
+
+static AtkStateSet *
+p_list_box_cell_accessible_ref_state_set (AtkObject *obj)
+{
+  PListBoxCellAccessible *accessible = (PListBoxCellAccessible *) obj;
+  PListBoxPrivate *priv;
+  AtkStateSet *state_set;
+  GtkAllocation allocation;
+  gint view_start, view_end;
+  gint y;
+
+  state_set = ATK_OBJECT_CLASS (p_list_box_cell_accessible_parent_class)->ref_state_set (obj);
+
+  if (accessible->info == NULL)
     {
-    case PROP_SELECTION_MODE:
-      g_value_set_enum (value, list_box->priv->selection_mode);
-      break;
-    case PROP_ACTIVATE_ON_SINGLE_CLICK:
-      g_value_set_boolean (value, list_box->priv->activate_single_click);
-      break;
-    default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, property_id, pspec);
-      break;
+      atk_state_set_add_state (state_set, ATK_STATE_DEFUNCT);
+      return state_set;
     }
+
+  priv = accessible->list_box->priv;
+  atk_state_set_add_state (state_set, ATK_STATE_ENABLED);
+  atk_state_set_add_state (state_set, ATK_STATE_SENSITIVE);
+  atk_state_set_add_state (state_set, ATK_STATE_VISIBLE);
+  atk_state_set_add_state (state_set, ATK_STATE_FOCUSABLE);
+  if (priv->selection_mode != GTK_SELECTION_NONE)
+    atk_state_set_add_state (state_set, ATK_STATE_SELECTABLE);
+  if (priv->selected_child == accessible->info)
+    atk_state_set_add_state (state_set, ATK_STATE_SELECTED);
+  if (priv->cursor_child == accessible->info &&
+      gtk_widget_has_focus (GTK_WIDGET (accessible->list_box)))
+    atk_state_set_add_state (state_set, ATK_STATE_FOCUSED);
+
+  gtk_widget_get_allocation (GTK_WIDGET (accessible->list_box), &allocation);
+  y = row_get_y (accessible->list_box, accessible->info);
+  if (!p_list_box_get_view_range (accessible->list_box, &allocation, &view_start, &view_end) ||
+      (y < view_end && y + row_get_height (accessible->list_box, accessible->info) > view_start))
+    atk_state_set_add_state (state_set, ATK_STATE_SHOWING);
+
+  return state_set;
 }
 
 static void
-p_list_box_set_property (GObject      *obj,
-                           guint         property_id,
-                           const GValue *value,
-                           GParamSpec   *pspec)
+p_list_box_cell_accessible_class_init (PListBoxCellAccessibleClass *klass)
 {
-  PListBox *list_box = P_LIST_BOX (obj);
+  AtkObjectClass *atk_class = ATK_OBJECT_CLASS (klass);
 
-  switch (property_id)
+  atk_class->get_index_in_parent = p_list_box_cell_accessible_get_index_in_parent;
+  atk_class->ref_state_set = p_list_box_cell_accessible_ref_state_set;
+}
+
+static void
+p_list_box_cell_accessible_update_name (PListBoxCellAccessible *accessible)
+{
+  PListBoxPrivate *priv = accessible->list_box->priv;
+  gchar *name;
+
+  if (priv->cell_funcs.describe == NULL)
+    return;
+
+  name = priv->cell_funcs.describe (accessible->list_box, accessible->info->cell_data,
+				    priv->cell_funcs_target);
+  atk_object_set_name (ATK_OBJECT (accessible), name != NULL ? name : "");
+  g_free (name);
+}
+
+/* Hash table value destroy function */
+static void
+p_list_box_cell_accessible_drop (PListBoxCellAccessible *accessible)
+{
+  accessible->info = NULL;
+  atk_object_notify_state_change (ATK_OBJECT (accessible), ATK_STATE_DEFUNCT, TRUE);
+  g_object_unref (accessible);
+}
+
+static AtkObject *
+p_list_box_get_cell_accessible (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxCellAccessible *accessible;
+
+  if (priv->cell_accessibles == NULL)
+    priv->cell_accessibles =
+      g_hash_table_new_full (g_direct_hash, g_direct_equal,
+			     NULL, (GDestroyNotify) p_list_box_cell_accessible_drop);
+
+  accessible = g_hash_table_lookup (priv->cell_accessibles, info);
+  if (accessible == NULL)
     {
-    case PROP_SELECTION_MODE:
-      p_list_box_set_selection_mode (list_box, g_value_get_enum (value));
-      break;
-    case PROP_ACTIVATE_ON_SINGLE_CLICK:
-      p_list_box_set_activate_on_single_click (list_box, g_value_get_boolean (value));
-      break;
-    default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, property_id, pspec);
-      break;
+      accessible = g_object_new (p_list_box_cell_accessible_get_type (), NULL);
+      accessible->list_box = list_box;
+      accessible->info = info;
+      atk_object_set_role (ATK_OBJECT (accessible), ATK_ROLE_LIST_ITEM);
+      atk_object_set_parent (ATK_OBJECT (accessible), gtk_widget_get_accessible (GTK_WIDGET (list_box)));
+      p_list_box_cell_accessible_update_name (accessible);
+      g_hash_table_insert (priv->cell_accessibles, info, accessible);
     }
+
+  return ATK_OBJECT (accessible);
 }
 
+/* Drops the accessibles of cells that are out of view, except for the
+   selected and the cursor cell, which clients are likely to track */
 static void
-p_list_box_finalize (GObject *obj)
+p_list_box_trim_cell_accessibles (PListBox *list_box)
 {
-  PListBox *list_box = P_LIST_BOX (obj);
   PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info;
+  GtkAllocation allocation;
+  GHashTableIter iter;
+  gint view_start, view_end;
+  gint y;
 
-  if (priv->auto_scroll_timeout_id != ((guint) 0))
-    g_source_remove (priv->auto_scroll_timeout_id);
+  if (priv->cell_accessibles == NULL ||
+      g_hash_table_size (priv->cell_accessibles) == 0)
+    return;
 
-  if (priv->sort_func_target_destroy_notify != NULL)
-    priv->sort_func_target_destroy_notify (priv->sort_func_target);
-  if (priv->filter_func_target_destroy_notify != NULL)
-    priv->filter_func_target_destroy_notify (priv->filter_func_target);
-  if (priv->update_separator_func_target_destroy_notify != NULL)
-    priv->update_separator_func_target_destroy_notify (priv->update_separator_func_target);
+  gtk_widget_get_allocation (GTK_WIDGET (list_box), &allocation);
+  if (!p_list_box_get_view_range (list_box, &allocation, &view_start, &view_end))
+    return;
 
-  g_clear_object (&priv->adjustment);
-  g_clear_object (&priv->drag_highlighted_widget);
+  g_hash_table_iter_init (&iter, priv->cell_accessibles);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &info, NULL))
+    {
+      if (info == priv->selected_child || info == priv->cursor_child)
+	continue;
+      y = row_get_y (list_box, info);
+      if (y >= view_end || y + row_get_height (list_box, info) <= view_start)
+	g_hash_table_iter_remove (&iter);
+    }
+}
 
-  g_sequence_free (priv->children);
-  g_hash_table_unref (priv->child_hash);
-  g_hash_table_unref (priv->separator_hash);
+typedef struct
+{
+  gint position;
+  gboolean added;
+} PListBoxA11yChange;
 
-  G_OBJECT_CLASS (p_list_box_parent_class)->finalize (obj);
+static gboolean
+p_list_box_accessible_flush (gpointer user_data)
+{
+  PListBox *list_box = user_data;
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxA11yChange *change;
+  GArray *changes;
+  guint i;
+
+  priv->a11y_idle_id = 0;
+  changes = priv->a11y_changes;
+  priv->a11y_changes = NULL;
+  if (changes == NULL)
+    return FALSE;
+
+  /* Clients ask for the added rows right away, lay them out once */
+  p_list_box_ensure_rows (list_box);
+  for (i = 0; i < changes->len && priv->accessible != NULL; i++)
+    {
+      change = &g_array_index (changes, PListBoxA11yChange, i);
+      g_signal_emit_by_name (priv->accessible,
+			     change->added ? "children-changed::add" : "children-changed::remove",
+			     change->position, NULL, NULL);
+    }
+  g_array_free (changes, TRUE);
+  return FALSE;
 }
 
+/* Tells clients a row came or went. The child is left out, so no row
+   accessible is created just for the notification. The notifications
+   go out together from an idle, so that clients looking up the new
+   rows do not make the row arrays get rebuilt after every change. */
 static void
-p_list_box_class_init (PListBoxClass *klass)
+p_list_box_accessible_row_changed (PListBox *list_box,
+				    gint position,
+				    gboolean added)
 {
-  GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
-  GtkContainerClass *container_class = GTK_CONTAINER_CLASS (klass);
-  GtkBindingSet *binding_set;
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxA11yChange change;
 
-  p_list_box_parent_class = g_type_class_peek_parent (klass);
+  if (priv->accessible == NULL)
+    return;
 
-  g_type_class_add_private (klass, sizeof (PListBoxPrivate));
+  if (priv->a11y_changes == NULL)
+    priv->a11y_changes = g_array_new (FALSE, FALSE, sizeof (PListBoxA11yChange));
+  change.position = position;
+  change.added = added;
+  g_array_append_val (priv->a11y_changes, change);
+  if (priv->a11y_idle_id == 0)
+    priv->a11y_idle_id = g_idle_add (p_list_box_accessible_flush, list_box);
+}
 
-  object_class->get_property = p_list_box_get_property;
-  object_class->set_property = p_list_box_set_property;
+/* Tells clients the rows were put in another order */
+static void
+p_list_box_accessible_reordered (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  if (priv->accessible == NULL)
+    return;
+
+  g_signal_emit_by_name (priv->accessible, "visible-data-changed");
+}
+
+static gint
+p_list_box_accessible_get_n_children (AtkObject *obj)
+{
+  GtkWidget *widget;
+
+  widget = gtk_accessible_get_widget (GTK_ACCESSIBLE (obj));
+  if (widget == NULL)
+    return 0;
+
+  return g_sequence_get_length (P_LIST_BOX (widget)->priv->children);
+}
+
+static AtkObject *
+p_list_box_accessible_ref_child (AtkObject *obj, gint i)
+{
+  PListBox *list_box;
+  PListBoxPrivate *priv;
+  PListBoxChildInfo *info;
+  GtkWidget *widget;
+
+  widget = gtk_accessible_get_widget (GTK_ACCESSIBLE (obj));
+  if (widget == NULL)
+    return NULL;
+
+  list_box = P_LIST_BOX (widget);
+  priv = list_box->priv;
+  p_list_box_ensure_rows (list_box);
+  if (i < 0 || i >= (gint) priv->n_rows)
+    return NULL;
+
+  info = priv->row_info[i];
+  if (info->widget != NULL)
+    return g_object_ref (gtk_widget_get_accessible (info->widget));
+
+  return g_object_ref (p_list_box_get_cell_accessible (list_box, info));
+}
+
+static void
+p_list_box_accessible_initialize (AtkObject *obj, gpointer data)
+{
+  PListBox *list_box = P_LIST_BOX (data);
+
+  ATK_OBJECT_CLASS (p_list_box_accessible_parent_class)->initialize (obj, data);
+
+  obj->role = ATK_ROLE_LIST;
+  list_box->priv->accessible = obj;
+  g_object_add_weak_pointer (G_OBJECT (obj), (gpointer *) &list_box->priv->accessible);
+}
+
+static void
+p_list_box_accessible_init (PListBoxAccessible *accessible)
+{
+}
+
+static void
+p_list_box_accessible_class_init (PListBoxAccessibleClass *klass)
+{
+  AtkObjectClass *atk_class = ATK_OBJECT_CLASS (klass);
+
+  atk_class->initialize = p_list_box_accessible_initialize;
+  atk_class->get_n_children = p_list_box_accessible_get_n_children;
+  atk_class->ref_child = p_list_box_accessible_ref_child;
+}
+
+GType
+p_list_box_layout_mode_get_type (void)
+{
+    static GType etype = 0;
+    if (G_UNLIKELY(etype == 0)) {
+        static const GEnumValue values[] = {
+            { P_LIST_BOX_LAYOUT_LIST, "P_LIST_BOX_LAYOUT_LIST", "list" },
+            { P_LIST_BOX_LAYOUT_GRID, "P_LIST_BOX_LAYOUT_GRID", "grid" },
+            { 0, NULL, NULL }
+        };
+        etype = g_enum_register_static (g_intern_static_string ("PListBoxLayoutMode"), values);
+    }
+    return etype;
+}
+
+GtkWidget *
+p_list_box_new (void)
+{
+  return g_object_new (P_TYPE_LIST_BOX, NULL);
+}
+
+static void
+p_list_box_init (PListBox *list_box)
+{
+  PListBoxPrivate *priv;
+
+  list_box->priv = priv =
+    G_TYPE_INSTANCE_GET_PRIVATE (list_box, P_TYPE_LIST_BOX, PListBoxPrivate);
+
+  gtk_widget_set_can_focus (GTK_WIDGET (list_box), TRUE);
+  gtk_widget_set_has_window (GTK_WIDGET (list_box), TRUE);
+  gtk_widget_set_redraw_on_allocate (GTK_WIDGET (list_box), TRUE);
+  priv->selection_mode = GTK_SELECTION_SINGLE;
+  priv->activate_single_click = TRUE;
+
+  priv->children = g_sequence_new ((GDestroyNotify)p_list_box_child_info_free);
+  priv->recycle_pool = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					      NULL, (GDestroyNotify) recycle_queue_free);
+  priv->recycle_limit = DEFAULT_RECYCLE_LIMIT;
+  priv->feed_budget = DEFAULT_FEED_BUDGET;
+  g_mutex_init (&priv->render_lock);
+  priv->tiles = g_queue_new ();
+  priv->tile_limit = DEFAULT_TILE_LIMIT;
+  priv->headers = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					 NULL, g_object_unref);
+  priv->header_height = -1;
+  priv->search_index = g_sequence_new ((GDestroyNotify) p_list_box_search_entry_free);
+  priv->search_text = g_string_new (NULL);
+  priv->columns_serial = 1;
+  priv->animations = g_ptr_array_new_with_free_func ((GDestroyNotify) p_list_box_row_animation_free);
+}
+
+static void
+p_list_box_get_property (GObject    *obj,
+                           guint       property_id,
+                           GValue     *value,
+                           GParamSpec *pspec)
+{
+  PListBox *list_box = P_LIST_BOX (obj);
+
+  switch (property_id)
+    {
+    case PROP_SELECTION_MODE:
+      g_value_set_enum (value, list_box->priv->selection_mode);
+      break;
+    case PROP_ACTIVATE_ON_SINGLE_CLICK:
+      g_value_set_boolean (value, list_box->priv->activate_single_click);
+      break;
+    case PROP_LAYOUT_MODE:
+      g_value_set_enum (value, list_box->priv->layout_mode);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, property_id, pspec);
+      break;
+    }
+}
+
+static void
+p_list_box_set_property (GObject      *obj,
+                           guint         property_id,
+                           const GValue *value,
+                           GParamSpec   *pspec)
+{
+  PListBox *list_box = P_LIST_BOX (obj);
+
+  switch (property_id)
+    {
+    case PROP_SELECTION_MODE:
+      p_list_box_set_selection_mode (list_box, g_value_get_enum (value));
+      break;
+    case PROP_ACTIVATE_ON_SINGLE_CLICK:
+      p_list_box_set_activate_on_single_click (list_box, g_value_get_boolean (value));
+      break;
+    case PROP_LAYOUT_MODE:
+      p_list_box_set_layout_mode (list_box, g_value_get_enum (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, property_id, pspec);
+      break;
+    }
+}
+
+static void
+p_list_box_finalize (GObject *obj)
+{
+  PListBox *list_box = P_LIST_BOX (obj);
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info;
+  GSequenceIter *iter;
+
+  if (priv->auto_scroll_timeout_id != ((guint) 0))
+    g_source_remove (priv->auto_scroll_timeout_id);
+  if (priv->feed_tick_id != 0)
+    gtk_widget_remove_tick_callback (GTK_WIDGET (list_box), priv->feed_tick_id);
+  p_list_box_feed_free_items (list_box);
+  if (priv->animation_tick_id != 0)
+    gtk_widget_remove_tick_callback (GTK_WIDGET (list_box), priv->animation_tick_id);
+  g_ptr_array_unref (priv->animations);
+  if (priv->create_child_func_target_destroy_notify != NULL)
+    priv->create_child_func_target_destroy_notify (priv->create_child_func_target);
+
+  if (priv->sort_func_target_destroy_notify != NULL)
+    priv->sort_func_target_destroy_notify (priv->sort_func_target);
+  if (priv->filter_func_target_destroy_notify != NULL)
+    priv->filter_func_target_destroy_notify (priv->filter_func_target);
+  if (priv->update_separator_func_target_destroy_notify != NULL)
+    priv->update_separator_func_target_destroy_notify (priv->update_separator_func_target);
+  if (priv->create_header_func_target_destroy_notify != NULL)
+    priv->create_header_func_target_destroy_notify (priv->create_header_func_target);
+  if (priv->search_key_func_target_destroy_notify != NULL)
+    priv->search_key_func_target_destroy_notify (priv->search_key_func_target);
+  if (priv->search_timeout_id != 0)
+    g_source_remove (priv->search_timeout_id);
+  if (priv->reflow_id != 0)
+    g_source_remove (priv->reflow_id);
+  if (priv->update_columns_func_target_destroy_notify != NULL)
+    priv->update_columns_func_target_destroy_notify (priv->update_columns_func_target);
+  p_list_box_free_columns (list_box);
+  if (priv->load_children_func_target_destroy_notify != NULL)
+    priv->load_children_func_target_destroy_notify (priv->load_children_func_target);
+
+  /* Widget rows are gone by now, but cells stay until the end. Render
+     jobs keep us alive, so none of them can be in flight here. */
+  for (iter = g_sequence_get_begin_iter (priv->children);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      info = g_sequence_get (iter);
+      if (info->widget != NULL)
+	continue;
+      p_list_box_drop_header (list_box, info);
+      if (priv->cell_data_destroy_notify != NULL)
+	priv->cell_data_destroy_notify (info->cell_data);
+      p_list_box_tile_free (info->tile);
+    }
+  if (priv->render_pool != NULL)
+    g_thread_pool_free (priv->render_pool, TRUE, TRUE);
+  g_queue_free (priv->tiles);
+  g_mutex_clear (&priv->render_lock);
+  p_list_box_render_target_unref (priv->cell_funcs_holder);
+  if (priv->cell_sort_func_target_destroy_notify != NULL)
+    priv->cell_sort_func_target_destroy_notify (priv->cell_sort_func_target);
+
+  if (priv->cell_accessibles != NULL)
+    g_hash_table_unref (priv->cell_accessibles);
+  if (priv->a11y_idle_id != 0)
+    g_source_remove (priv->a11y_idle_id);
+  if (priv->a11y_changes != NULL)
+    g_array_free (priv->a11y_changes, TRUE);
+  if (priv->accessible != NULL)
+    g_object_remove_weak_pointer (G_OBJECT (priv->accessible), (gpointer *) &priv->accessible);
+
+  g_clear_object (&priv->adjustment);
+  g_clear_object (&priv->drag_highlighted_widget);
+
+  g_sequence_free (priv->children);
+  g_free (priv->row_info);
+  g_free (priv->row_y);
+  g_free (priv->row_height);
+  g_free (priv->row_separator_height);
+  g_free (priv->row_flags);
+  g_free (priv->section_info);
+  g_free (priv->section_y);
+  g_free (priv->grid_rows);
+  g_free (priv->grid_ordinal);
+  g_free (priv->anim_base_y);
+  g_free (priv->anim_section_y);
+  g_hash_table_unref (priv->headers);
+  g_sequence_free (priv->search_index);
+  g_string_free (priv->search_text, TRUE);
+  g_hash_table_unref (priv->recycle_pool);
+
+  G_OBJECT_CLASS (p_list_box_parent_class)->finalize (obj);
+}
+
+static void
+p_list_box_class_init (PListBoxClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+  GtkContainerClass *container_class = GTK_CONTAINER_CLASS (klass);
+  GtkBindingSet *binding_set;
+
+  p_list_box_parent_class = g_type_class_peek_parent (klass);
+
+  g_type_class_add_private (klass, sizeof (PListBoxPrivate));
+  child_info_quark = g_quark_from_static_string ("p-list-box-child-info");
+  header_quark = g_quark_from_static_string ("p-list-box-header");
+
+  object_class->get_property = p_list_box_get_property;
+  object_class->set_property = p_list_box_set_property;
   object_class->finalize = p_list_box_finalize;
   widget_class->enter_notify_event = p_list_box_real_enter_notify_event;
   widget_class->leave_notify_event = p_list_box_real_leave_notify_event;
   widget_class->motion_notify_event = p_list_box_real_motion_notify_event;
   widget_class->button_press_event = p_list_box_real_button_press_event;
   widget_class->button_release_event = p_list_box_real_button_release_event;
+  widget_class->key_press_event = p_list_box_real_key_press_event;
   widget_class->show = p_list_box_real_show;
   widget_class->focus = p_list_box_real_focus;
   widget_class->draw = p_list_box_real_draw;
   widget_class->realize = p_list_box_real_realize;
+  widget_class->unrealize = p_list_box_real_unrealize;
   widget_class->compute_expand = p_list_box_real_compute_expand_internal;
   widget_class->get_request_mode = p_list_box_real_get_request_mode;
   widget_class->get_preferred_height = p_list_box_real_get_preferred_height;
@@ -362,6 +1410,7 @@ p_list_box_class_init (PListBoxClass *klass)
   widget_class->size_allocate = p_list_box_real_size_allocate;
   widget_class->drag_leave = p_list_box_real_drag_leave;
   widget_class->drag_motion = p_list_box_real_drag_motion;
+  gtk_widget_class_set_accessible_type (widget_class, p_list_box_accessible_get_type ());
   container_class->add = p_list_box_real_add;
   container_class->remove = p_list_box_real_remove;
   container_class->forall = p_list_box_real_forall_internal;
@@ -386,6 +1435,14 @@ p_list_box_class_init (PListBoxClass *klass)
                           TRUE,
                           G_PARAM_READWRITE);
 
+  properties[PROP_LAYOUT_MODE] =
+    g_param_spec_enum ("layout-mode",
+                       "Layout mode",
+                       "Whether rows are stacked or laid out in a grid",
+                       P_TYPE_LIST_BOX_LAYOUT_MODE,
+                       P_LIST_BOX_LAYOUT_LIST,
+                       G_PARAM_READWRITE);
+
   g_object_class_install_properties (object_class, LAST_PROPERTY, properties);
 
   signals[CHILD_SELECTED] =
@@ -439,6 +1496,24 @@ p_list_box_class_init (PListBoxClass *klass)
 		  NULL, NULL,
 		  g_cclosure_marshal_VOID__VOID,
 		  G_TYPE_NONE, 0);
+  signals[CELL_SELECTED] =
+    g_signal_new ("cell-selected",
+		  P_TYPE_LIST_BOX,
+		  G_SIGNAL_RUN_LAST,
+		  0,
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1,
+		  G_TYPE_POINTER);
+  signals[CELL_ACTIVATED] =
+    g_signal_new ("cell-activated",
+		  P_TYPE_LIST_BOX,
+		  G_SIGNAL_RUN_LAST,
+		  0,
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1,
+		  G_TYPE_POINTER);
 
   widget_class->activate_signal = signals[ACTIVATE_CURSOR_CHILD];
 
@@ -467,6 +1542,15 @@ p_list_box_class_init (PListBoxClass *klass)
 				 GTK_MOVEMENT_PAGES, 1);
   p_list_box_add_move_binding (binding_set, GDK_KEY_KP_Page_Down, 0,
 				 GTK_MOVEMENT_PAGES, 1);
+  /* Plain Left and Right go through focus, to reach into rows */
+  p_list_box_add_move_binding (binding_set, GDK_KEY_Left, GDK_CONTROL_MASK,
+				 GTK_MOVEMENT_VISUAL_POSITIONS, -1);
+  p_list_box_add_move_binding (binding_set, GDK_KEY_KP_Left, GDK_CONTROL_MASK,
+				 GTK_MOVEMENT_VISUAL_POSITIONS, -1);
+  p_list_box_add_move_binding (binding_set, GDK_KEY_Right, GDK_CONTROL_MASK,
+				 GTK_MOVEMENT_VISUAL_POSITIONS, 1);
+  p_list_box_add_move_binding (binding_set, GDK_KEY_KP_Right, GDK_CONTROL_MASK,
+				 GTK_MOVEMENT_VISUAL_POSITIONS, 1);
   gtk_binding_entry_add_signal (binding_set, GDK_KEY_space, GDK_CONTROL_MASK,
 				"toggle-cursor-child", 0, NULL);
 }
@@ -508,7 +1592,32 @@ p_list_box_get_child_at_y (PListBox *list_box, gint y)
 
   g_return_val_if_fail (list_box != NULL, NULL);
 
-  child = p_list_box_find_child_at_y (list_box, y);
+  child = p_list_box_find_child_at (list_box, 0, y);
+  if (child == NULL)
+    return NULL;
+
+  return child->widget;
+}
+
+/**
+ * p_list_box_get_child_at_pos:
+ * @self: An #PListBox.
+ * @x: The x coordinate of the child.
+ * @y: The y coordinate of the child.
+ *
+ * Gets the child at the given position, which in grid mode also
+ * depends on @x.
+ *
+ * Return value: (transfer none): The child #GtkWidget.
+ **/
+GtkWidget *
+p_list_box_get_child_at_pos (PListBox *list_box, gint x, gint y)
+{
+  PListBoxChildInfo *child;
+
+  g_return_val_if_fail (list_box != NULL, NULL);
+
+  child = p_list_box_find_child_at (list_box, x, y);
   if (child == NULL)
     return NULL;
 
@@ -544,8 +1653,16 @@ p_list_box_set_adjustment (PListBox *list_box,
 
   g_object_ref (adjustment);
   if (priv->adjustment)
-    g_object_unref (priv->adjustment);
+    {
+      g_signal_handlers_disconnect_by_func (priv->adjustment,
+					    p_list_box_adjustment_changed, list_box);
+      g_object_unref (priv->adjustment);
+    }
   priv->adjustment = adjustment;
+  g_signal_connect_object (adjustment, "value-changed",
+			   (GCallback) p_list_box_adjustment_changed, list_box, 0);
+  g_signal_connect_object (adjustment, "changed",
+			   (GCallback) p_list_box_adjustment_changed, list_box, 0);
   gtk_container_set_focus_vadjustment (GTK_CONTAINER (list_box),
 				       adjustment);
 }
@@ -648,9 +1765,51 @@ do_sort (PListBoxChildInfo *a,
 	 PListBox *list_box)
 {
   PListBoxPrivate *priv = list_box->priv;
+  gint res;
 
-  return priv->sort_func (a->widget, b->widget,
-			  priv->sort_func_target);
+  /* Cells follow the widget rows, in the order they were added
+     unless they have a sort function of their own */
+  if (a->widget == NULL || b->widget == NULL)
+    {
+      if (a->widget != NULL)
+	return -1;
+      if (b->widget != NULL)
+	return 1;
+      if (priv->cell_sort_func != NULL)
+	return priv->cell_sort_func (a->cell_data, b->cell_data,
+				     priv->cell_sort_func_target);
+      return a->serial < b->serial ? -1 : a->serial > b->serial;
+    }
+
+  /* In a tree, rows go after their ancestors and are otherwise ordered
+     like the ancestors that are siblings */
+  if (a->parent_row != b->parent_row)
+    {
+      PListBoxChildInfo *pa = a, *pb = b;
+
+      while (pa->depth > pb->depth)
+	pa = pa->parent_row;
+      while (pb->depth > pa->depth)
+	pb = pb->parent_row;
+      if (pa == pb)
+	return a->depth < b->depth ? -1 : 1;
+      while (pa->parent_row != pb->parent_row)
+	{
+	  pa = pa->parent_row;
+	  pb = pb->parent_row;
+	}
+      a = pa;
+      b = pb;
+    }
+
+  res = priv->sort_func (a->widget, b->widget,
+			 priv->sort_func_target);
+  if (res != 0)
+    return res;
+
+  /* Rows the sort function can't tell apart keep the order they were
+     added in, which keeps their subtrees from interleaving */
+  return a->serial < b->serial ? -1 : a->serial > b->serial;
 }
 
 void
@@ -662,7 +1821,9 @@ p_list_box_resort (PListBox *list_box)
 
   g_sequence_sort (priv->children,
 		   (GCompareDataFunc)do_sort, list_box);
+  priv->rows_dirty = TRUE;
   p_list_box_reseparate (list_box);
+  p_list_box_accessible_reordered (list_box);
   gtk_widget_queue_resize (GTK_WIDGET (list_box));
 }
 
@@ -712,7 +1873,8 @@ p_list_box_child_changed (PListBox *list_box, GtkWidget *widget)
 {
   PListBoxPrivate *priv = list_box->priv;
   PListBoxChildInfo *info;
-  GSequenceIter *prev_next, *next;
+  GSequenceIter *prev_next, *next, *end;
+  GSequence *subtree;
 
   g_return_if_fail (list_box != NULL);
   g_return_if_fail (widget != NULL);
@@ -721,12 +1883,35 @@ p_list_box_child_changed (PListBox *list_box, GtkWidget *widget)
   if (info == NULL)
     return;
 
+  p_list_box_index_row (list_box, info);
+  info->has_windows = p_list_box_widget_has_windows (widget);
+  /* Rows below a collapsed row are sorted and filtered when it expands */
+  if (g_sequence_iter_get_sequence (info->iter) != priv->children)
+    return;
+
   prev_next = p_list_box_get_next_visible (list_box, info->iter);
   if (priv->sort_func != NULL)
     {
+      /* The expanded descendants move along with the row */
+      subtree = NULL;
+      end = p_list_box_get_subtree_end (info);
+      if (end != g_sequence_iter_next (info->iter))
+	{
+	  subtree = g_sequence_new (NULL);
+	  g_sequence_move_range (g_sequence_get_end_iter (subtree),
+				 g_sequence_iter_next (info->iter), end);
+	}
       g_sequence_sort_changed (info->iter,
 			       (GCompareDataFunc)do_sort,
 			       list_box);
+      if (subtree != NULL)
+	{
+	  g_sequence_move_range (g_sequence_iter_next (info->iter),
+				 g_sequence_get_begin_iter (subtree),
+				 g_sequence_get_end_iter (subtree));
+	  g_sequence_free (subtree);
+	}
+      priv->rows_dirty = TRUE;
       gtk_widget_queue_resize (GTK_WIDGET (list_box));
     }
   p_list_box_apply_filter (list_box, info->widget);
@@ -775,27 +1960,41 @@ p_list_box_add_move_binding (GtkBindingSet *binding_set,
 }
 
 static PListBoxChildInfo*
-p_list_box_find_child_at_y (PListBox *list_box, gint y)
+p_list_box_find_child_at (PListBox *list_box, gint x, gint y)
 {
   PListBoxPrivate *priv = list_box->priv;
-  PListBoxChildInfo *child_info;
-  GSequenceIter *iter;
-  PListBoxChildInfo *info;
+  guint i, col, ordinal;
+  gint width;
 
-  child_info = NULL;
-  for (iter = g_sequence_get_begin_iter (priv->children);
-       !g_sequence_iter_is_end (iter);
-       iter = g_sequence_iter_next (iter))
+  /* A tile's band and column follow from the position directly */
+  if (priv->layout_mode == P_LIST_BOX_LAYOUT_GRID)
     {
-      info = (PListBoxChildInfo*) g_sequence_get (iter);
-      if (y >= info->y && y < (info->y + info->height))
-	{
-	  child_info = info;
-	  break;
-	}
+      p_list_box_ensure_rows (list_box);
+      width = gtk_widget_get_allocated_width (GTK_WIDGET (list_box));
+      if (priv->n_grid == 0 || priv->grid_band_height <= 0 ||
+	  x < 0 || x >= width || y < 0)
+	return NULL;
+
+      col = (guint) x * priv->grid_columns / width;
+      if (gtk_widget_get_direction (GTK_WIDGET (list_box)) == GTK_TEXT_DIR_RTL)
+	col = priv->grid_columns - 1 - col;
+      ordinal = (y / priv->grid_band_height) * priv->grid_columns + col;
+      if (ordinal >= priv->n_grid)
+	return NULL;
+
+      return priv->row_info[priv->grid_rows[ordinal]];
     }
 
-  return child_info;
+  /* The pinned header covers the rows below it */
+  if (priv->pinned_section != NULL &&
+      y >= priv->pinned_y && y < priv->pinned_y + priv->header_height)
+    return NULL;
+
+  i = p_list_box_bisect_rows (list_box, y);
+  if (i < priv->n_rows && y >= priv->row_y[i])
+    return priv->row_info[i];
+
+  return NULL;
 }
 
 static void
@@ -812,8 +2011,8 @@ p_list_box_update_cursor (PListBox *list_box,
       GtkAllocation allocation;
       gtk_widget_get_allocation (GTK_WIDGET (list_box), &allocation);
       gtk_adjustment_clamp_page (priv->adjustment,
-				 priv->cursor_child->y + allocation.y,
-				 priv->cursor_child->y + allocation.y + priv->cursor_child->height);
+				 row_get_y (list_box, child) + allocation.y,
+				 row_get_y (list_box, child) + allocation.y + row_get_height (list_box, child));
   }
 }
 
@@ -823,12 +2022,18 @@ p_list_box_update_selected (PListBox *list_box,
 {
   PListBoxPrivate *priv = list_box->priv;
 
+  PListBoxChildInfo *old_selected = priv->selected_child;
+
   if (child != priv->selected_child &&
       (child == NULL || priv->selection_mode != GTK_SELECTION_NONE))
     {
       priv->selected_child = child;
       g_signal_emit (list_box, signals[CHILD_SELECTED], 0,
 		     (priv->selected_child != NULL) ? priv->selected_child->widget : NULL);
+      if ((child != NULL && child->widget == NULL) ||
+	  (old_selected != NULL && old_selected->widget == NULL))
+	g_signal_emit (list_box, signals[CELL_SELECTED], 0,
+		       (child != NULL && child->widget == NULL) ? child : NULL);
       gtk_widget_queue_draw (GTK_WIDGET (list_box));
     }
   if (child != NULL)
@@ -836,17 +2041,21 @@ p_list_box_update_selected (PListBox *list_box,
 }
 
 static void
-p_list_box_select_and_activate (PListBox *list_box, PListBoxChildInfo *child)
+p_list_box_emit_activated (PListBox *list_box, PListBoxChildInfo *child)
 {
-  GtkWidget *w = NULL;
-
-  if (child != NULL)
-    w = child->widget;
+  if (child->widget != NULL)
+    g_signal_emit (list_box, signals[CHILD_ACTIVATED], 0, child->widget);
+  else
+    g_signal_emit (list_box, signals[CELL_ACTIVATED], 0, child);
+}
 
+static void
+p_list_box_select_and_activate (PListBox *list_box, PListBoxChildInfo *child)
+{
   p_list_box_update_selected (list_box, child);
 
-  if (w != NULL)
-    g_signal_emit (list_box, signals[CHILD_ACTIVATED], 0, w);
+  if (child != NULL)
+    p_list_box_emit_activated (list_box, child);
 }
 
 static void
@@ -887,7 +2096,7 @@ p_list_box_real_enter_notify_event (GtkWidget *widget,
   if (event->window != gtk_widget_get_window (GTK_WIDGET (list_box)))
     return FALSE;
 
-  child = p_list_box_find_child_at_y (list_box, event->y);
+  child = p_list_box_find_child_at (list_box, event->x, event->y);
   p_list_box_update_prelight (list_box, child);
   p_list_box_update_active (list_box, child);
 
@@ -907,7 +2116,7 @@ p_list_box_real_leave_notify_event (GtkWidget *widget,
   if (event->detail != GDK_NOTIFY_INFERIOR)
     child = NULL;
   else
-    child = p_list_box_find_child_at_y (list_box, event->y);
+    child = p_list_box_find_child_at (list_box, event->x, event->y);
 
   p_list_box_update_prelight (list_box, child);
   p_list_box_update_active (list_box, child);
@@ -922,21 +2131,23 @@ p_list_box_real_motion_notify_event (GtkWidget *widget,
   PListBox *list_box = P_LIST_BOX (widget);
   PListBoxChildInfo *child;
   GdkWindow *window, *event_window;
-  gint relative_y;
-  gdouble parent_y;
+  gint relative_x, relative_y;
+  gdouble parent_x, parent_y;
 
   window = gtk_widget_get_window (GTK_WIDGET (list_box));
   event_window = event->window;
+  relative_x = event->x;
   relative_y = event->y;
 
   while ((event_window != NULL) && (event_window != window))
     {
-      gdk_window_coords_to_parent (event_window, 0, relative_y, NULL, &parent_y);
+      gdk_window_coords_to_parent (event_window, relative_x, relative_y, &parent_x, &parent_y);
+      relative_x = parent_x;
       relative_y = parent_y;
       event_window = gdk_window_get_effective_parent (event_window);
     }
 
-  child = p_list_box_find_child_at_y (list_box, relative_y);
+  child = p_list_box_find_child_at (list_box, relative_x, relative_y);
   p_list_box_update_prelight (list_box, child);
   p_list_box_update_active (list_box, child);
 
@@ -953,7 +2164,10 @@ p_list_box_real_button_press_event (GtkWidget *widget,
   if (event->button == GDK_BUTTON_PRIMARY)
     {
       PListBoxChildInfo *child;
-      child = p_list_box_find_child_at_y (list_box, event->y);
+      child = p_list_box_find_child_at (list_box, event->x, event->y);
+      if (child != NULL && child->widget == NULL &&
+	  !p_list_box_cell_hit_test (list_box, child, event->x, event->y))
+	child = NULL;
       if (child != NULL)
 	{
 	  priv->active_child = child;
@@ -961,8 +2175,7 @@ p_list_box_real_button_press_event (GtkWidget *widget,
 	  gtk_widget_queue_draw (GTK_WIDGET (list_box));
 	  if (event->type == GDK_2BUTTON_PRESS &&
 	      !priv->activate_single_click)
-	    g_signal_emit (list_box, signals[CHILD_ACTIVATED], 0,
-			   child->widget);
+	    p_list_box_emit_activated (list_box, child);
 
 	}
       /* TODO:
@@ -1021,6 +2234,7 @@ p_list_box_real_focus (GtkWidget* widget, GtkDirectionType direction)
   PListBoxChildInfo *next_focus_child;
   gboolean modify_selection_pressed;
   GdkModifierType state = 0;
+  gint delta;
 
   recurse_into = NULL;
   focus_into = TRUE;
@@ -1028,7 +2242,25 @@ p_list_box_real_focus (GtkWidget* widget, GtkDirectionType direction)
   g_object_get (GTK_WIDGET (list_box), "has-focus", &had_focus, NULL);
   current_focus_child = NULL;
   next_focus_child = NULL;
-  if (had_focus)
+  /* Tiles are neighbours in all four directions */
+  if (had_focus && priv->layout_mode == P_LIST_BOX_LAYOUT_GRID &&
+      priv->cursor_child != NULL &&
+      (direction == GTK_DIR_UP || direction == GTK_DIR_DOWN ||
+       direction == GTK_DIR_LEFT || direction == GTK_DIR_RIGHT))
+    {
+      delta = 1;
+      if (direction == GTK_DIR_UP || direction == GTK_DIR_DOWN)
+	delta = priv->grid_columns;
+      else if (gtk_widget_get_direction (widget) == GTK_TEXT_DIR_RTL)
+	delta = -1;
+      if (direction == GTK_DIR_UP || direction == GTK_DIR_LEFT)
+	delta = -delta;
+
+      next_focus_child = p_list_box_grid_offset (list_box, priv->cursor_child, delta);
+      if (next_focus_child == NULL)
+	return gtk_widget_keynav_failed (widget, direction);
+    }
+  else if (had_focus)
     {
       /* If on row, going right, enter into possible container */
       if (direction == GTK_DIR_RIGHT || direction == GTK_DIR_TAB_FORWARD)
@@ -1171,6 +2403,51 @@ child_flags_find_or_add (ChildFlags *array,
   return &array[*array_length - 1];
 }
 
+static void
+p_list_box_draw_cell (PListBox *list_box,
+		       PListBoxChildInfo *child_info,
+		       cairo_t *cr,
+		       GtkStateFlags state,
+		       gint width,
+		       gint focus)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  gint cell_width, cell_height;
+  gint x;
+
+  if (priv->cell_funcs.draw == NULL && priv->cell_funcs.render == NULL)
+    return;
+
+  if (child_info == priv->selected_child)
+    state |= GTK_STATE_FLAG_SELECTED;
+  if (child_info == priv->prelight_child)
+    state |= GTK_STATE_FLAG_PRELIGHT;
+  if (child_info == priv->active_child && priv->active_child_active)
+    state |= GTK_STATE_FLAG_ACTIVE;
+
+  p_list_box_get_row_span (list_box, child_info->index, width, &x, &width);
+  cell_width = width - 2 * focus;
+  cell_height = priv->row_height[child_info->index];
+  /* A growing cell is drawn at its full height and clipped */
+  if (child_info->animation != NULL)
+    cell_height = MAX (cell_height, child_info->animation->height);
+  cell_height -= 2 * focus;
+
+  cairo_save (cr);
+  cairo_translate (cr, x + focus, priv->row_y[child_info->index] + focus);
+  cairo_rectangle (cr, 0, 0, cell_width, cell_height);
+  cairo_clip (cr);
+  /* Until its tile is ready a rendered cell falls back to the draw
+     callback, if there is one */
+  if ((priv->cell_funcs.render == NULL ||
+       !p_list_box_draw_tile (list_box, child_info, cr, cell_width, cell_height)) &&
+      priv->cell_funcs.draw != NULL)
+    priv->cell_funcs.draw (list_box, child_info->cell_data, cr,
+			   cell_width, cell_height, state,
+			   priv->cell_funcs_target);
+  cairo_restore (cr);
+}
+
 static gboolean
 p_list_box_real_draw (GtkWidget* widget, cairo_t* cr)
 {
@@ -1179,9 +2456,12 @@ p_list_box_real_draw (GtkWidget* widget, cairo_t* cr)
   GtkAllocation allocation = {0};
   GtkStyleContext* context;
   GtkStateFlags state;
+  GdkRectangle clip;
   ChildFlags flags[3], *found;
   gint flags_length;
   gint focus_pad;
+  gint focus;
+  gint x, width;
   int i;
 
   gtk_widget_get_allocation (GTK_WIDGET (list_box), &allocation);
@@ -1189,6 +2469,7 @@ p_list_box_real_draw (GtkWidget* widget, cairo_t* cr)
   state = gtk_widget_get_state_flags (widget);
   gtk_render_background (context, cr, (gdouble) 0, (gdouble) 0, (gdouble) allocation.width, (gdouble) allocation.height);
   flags_length = 0;
+  p_list_box_ensure_rows (list_box);
 
   if (priv->selected_child != NULL)
     {
@@ -1211,9 +2492,11 @@ p_list_box_real_draw (GtkWidget* widget, cairo_t* cr)
   for (i = 0; i < flags_length; i++)
     {
       ChildFlags *flag = &flags[i];
+      p_list_box_get_row_span (list_box, flag->child->index, allocation.width, &x, &width);
       gtk_style_context_save (context);
       gtk_style_context_set_state (context, flag->state);
-      gtk_render_background (context, cr, 0, flag->child->y, allocation.width, flag->child->height);
+      gtk_render_background (context, cr, x, priv->row_y[flag->child->index],
+			     width, priv->row_height[flag->child->index]);
       gtk_style_context_restore (context);
     }
 
@@ -1222,25 +2505,111 @@ p_list_box_real_draw (GtkWidget* widget, cairo_t* cr)
       gtk_style_context_get_style (context,
                                    "focus-padding", &focus_pad,
                                    NULL);
-      gtk_render_focus (context, cr, focus_pad, priv->cursor_child->y + focus_pad,
-                        allocation.width - 2 * focus_pad, priv->cursor_child->height - 2 * focus_pad);
+      p_list_box_get_row_span (list_box, priv->cursor_child->index, allocation.width, &x, &width);
+      gtk_render_focus (context, cr, x + focus_pad, priv->row_y[priv->cursor_child->index] + focus_pad,
+                        width - 2 * focus_pad, priv->row_height[priv->cursor_child->index] - 2 * focus_pad);
     }
 
-  GTK_WIDGET_CLASS (p_list_box_parent_class)->draw ((GtkWidget*) G_TYPE_CHECK_INSTANCE_CAST (list_box, GTK_TYPE_CONTAINER, GtkContainer), cr);
-
-  return TRUE;
-}
+  if (!gdk_cairo_get_clip_rectangle (cr, &clip))
+    {
+      clip.x = 0;
+      clip.y = 0;
+      clip.width = allocation.width;
+      clip.height = allocation.height;
+    }
+  focus = p_list_box_get_focus_size (list_box);
 
+  /* Not chaining up to GtkContainer, only rows in the clip are drawn,
+     and rows that were left behind by a partial allocation must not be
+     drawn at their old position */
+  for (i = p_list_box_bisect_rows (list_box, clip.y); i < (gint) priv->n_rows; i++)
+    {
+      PListBoxChildInfo *child_info = priv->row_info[i];
 
-static void
-p_list_box_real_realize (GtkWidget* widget)
-{
-  PListBox *list_box = P_LIST_BOX (widget);
-  GtkAllocation allocation;
-  GdkWindowAttr attributes = {0};
-  GdkWindow *window;
+      if (priv->row_y[i] - priv->row_separator_height[i] >= clip.y + clip.height)
+	break;
+      if ((priv->row_flags[i] & ROW_VISIBLE) == 0)
+	continue;
 
-  gtk_widget_get_allocation (GTK_WIDGET (list_box), &allocation);
+      if (child_info->animation != NULL &&
+	  (priv->row_flags[i] & ROW_ALLOC_STALE) == 0)
+	{
+	  p_list_box_draw_animated_row (list_box, child_info, cr, state,
+					allocation.width, focus);
+	  continue;
+	}
+
+      if (child_info->widget == NULL)
+	{
+	  p_list_box_draw_cell (list_box, child_info, cr, state,
+				allocation.width, focus);
+	  continue;
+	}
+
+      if (priv->row_flags[i] & ROW_ALLOC_STALE)
+	continue;
+      if (child_info->separator != NULL &&
+	  priv->layout_mode == P_LIST_BOX_LAYOUT_LIST)
+	gtk_container_propagate_draw (GTK_CONTAINER (list_box), child_info->separator, cr);
+      gtk_container_propagate_draw (GTK_CONTAINER (list_box), child_info->widget, cr);
+    }
+
+  /* Removed rows, from their snapshots */
+  for (i = 0; i < (gint) priv->animations->len; i++)
+    {
+      PListBoxRowAnimation *animation = g_ptr_array_index (priv->animations, i);
+
+      if (animation->surface == NULL ||
+	  animation->visible_height <= 0 ||
+	  animation->y >= clip.y + clip.height ||
+	  animation->y + animation->visible_height <= clip.y)
+	continue;
+
+      cairo_save (cr);
+      cairo_rectangle (cr, 0, animation->y, allocation.width, animation->visible_height);
+      cairo_clip (cr);
+      cairo_set_source_surface (cr, animation->surface, 0, animation->y);
+      cairo_paint_with_alpha (cr, animation->progress);
+      cairo_restore (cr);
+    }
+
+  if (g_hash_table_size (priv->headers) > 0)
+    {
+      PListBoxChildInfo *section;
+      GtkWidget *header;
+      guint s;
+
+      for (s = priv->header_first; s <= priv->header_last && s < priv->n_sections; s++)
+	{
+	  section = priv->section_info[s];
+	  header = g_hash_table_lookup (priv->headers, section);
+	  if (header != NULL && section != priv->pinned_section)
+	    gtk_container_propagate_draw (GTK_CONTAINER (list_box), header, cr);
+	}
+
+      /* Last, over the rows scrolled under it */
+      if (priv->pinned_section != NULL)
+	{
+	  header = g_hash_table_lookup (priv->headers, priv->pinned_section);
+	  gtk_render_background (context, cr, 0, priv->pinned_y,
+				 allocation.width, priv->header_height);
+	  gtk_container_propagate_draw (GTK_CONTAINER (list_box), header, cr);
+	}
+    }
+
+  return TRUE;
+}
+
+
+static void
+p_list_box_real_realize (GtkWidget* widget)
+{
+  PListBox *list_box = P_LIST_BOX (widget);
+  GtkAllocation allocation;
+  GdkWindowAttr attributes = {0};
+  GdkWindow *window;
+
+  gtk_widget_get_allocation (GTK_WIDGET (list_box), &allocation);
   gtk_widget_set_realized (GTK_WIDGET (list_box), TRUE);
 
   attributes.x = allocation.x;
@@ -1260,6 +2629,17 @@ p_list_box_real_realize (GtkWidget* widget)
   gtk_widget_set_window (GTK_WIDGET (list_box), window); /* Passes ownership */
 }
 
+static void
+p_list_box_real_unrealize (GtkWidget* widget)
+{
+  PListBox *list_box = P_LIST_BOX (widget);
+
+  /* Parked rows are only worth keeping while the list is on screen */
+  p_list_box_trim_recycled (list_box);
+
+  GTK_WIDGET_CLASS (p_list_box_parent_class)->unrealize (widget);
+}
+
 
 static void
 p_list_box_apply_filter (PListBox *list_box, GtkWidget *child)
@@ -1274,6 +2654,27 @@ p_list_box_apply_filter (PListBox *list_box, GtkWidget *child)
   gtk_widget_set_child_visible (child, do_show);
 }
 
+/* Calls func on each row of rows and on the rows collapsed below them */
+static void
+p_list_box_foreach_row (PListBox *list_box,
+			 GSequence *rows,
+			 void (*func) (PListBox *list_box, PListBoxChildInfo *info))
+{
+  PListBoxChildInfo *info;
+  GSequenceIter *iter;
+
+  for (iter = g_sequence_get_begin_iter (rows);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      info = g_sequence_get (iter);
+      func (list_box, info);
+      if (info->collapsed != NULL)
+	p_list_box_foreach_row (list_box, info->collapsed, func);
+    }
+}
+
+/* Rows below a collapsed row are filtered when it expands */
 static void
 p_list_box_apply_filter_all (PListBox *list_box)
 {
@@ -1286,7 +2687,8 @@ p_list_box_apply_filter_all (PListBox *list_box)
        iter = g_sequence_iter_next (iter))
     {
       child_info = g_sequence_get (iter);
-      p_list_box_apply_filter (list_box, child_info->widget);
+      if (child_info->widget != NULL)
+	p_list_box_apply_filter (list_box, child_info->widget);
     }
 }
 
@@ -1298,6 +2700,13 @@ child_is_visible (GtkWidget *child)
   return gtk_widget_get_visible (child) && gtk_widget_get_child_visible (child);
 }
 
+/* Cells are never hidden or filtered */
+static gboolean
+child_info_is_visible (PListBoxChildInfo *info)
+{
+  return info->widget == NULL || child_is_visible (info->widget);
+}
+
 static PListBoxChildInfo*
 p_list_box_get_first_visible (PListBox *list_box)
 {
@@ -1310,7 +2719,7 @@ p_list_box_get_first_visible (PListBox *list_box)
        iter = g_sequence_iter_next (iter))
     {
 	child_info = g_sequence_get (iter);
-	if (child_is_visible (child_info->widget))
+	if (child_info_is_visible (child_info))
 	  return child_info;
     }
 
@@ -1330,7 +2739,7 @@ p_list_box_get_last_visible (PListBox *list_box)
     {
       iter = g_sequence_iter_prev (iter);
       child_info = g_sequence_get (iter);
-      if (child_is_visible (child_info->widget))
+      if (child_info_is_visible (child_info))
 	return child_info;
     }
 
@@ -1350,7 +2759,7 @@ p_list_box_get_previous_visible (PListBox *list_box,
     {
       iter = g_sequence_iter_prev (iter);
       child_info = g_sequence_get (iter);
-      if (child_is_visible (child_info->widget))
+      if (child_info_is_visible (child_info))
 	return iter;
     }
   while (!g_sequence_iter_is_begin (iter));
@@ -1372,7 +2781,7 @@ p_list_box_get_next_visible (PListBox *list_box, GSequenceIter* iter)
       if (!g_sequence_iter_is_end (iter))
 	{
 	child_info = g_sequence_get (iter);
-	if (child_is_visible (child_info->widget))
+	if (child_info_is_visible (child_info))
 	  return iter;
 	}
     }
@@ -1411,7 +2820,7 @@ p_list_box_update_separator (PListBox *list_box, GSequenceIter* iter)
     }
 
   if (priv->update_separator_func != NULL &&
-      child_is_visible (child))
+      child != NULL && child_is_visible (child))
     {
       old_separator = info->separator;
       if (old_separator)
@@ -1425,11 +2834,11 @@ p_list_box_update_separator (PListBox *list_box, GSequenceIter* iter)
 	  if (old_separator != NULL)
 	    {
 	      gtk_widget_unparent (old_separator);
-	      g_hash_table_remove (priv->separator_hash, old_separator);
+	      g_object_set_qdata (G_OBJECT (old_separator), child_info_quark, NULL);
 	    }
 	  if (info->separator != NULL)
 	    {
-	      g_hash_table_insert (priv->separator_hash, info->separator, info);
+	      g_object_set_qdata (G_OBJECT (info->separator), child_info_quark, info);
 	      gtk_widget_set_parent (info->separator, GTK_WIDGET (list_box));
 	      gtk_widget_show (info->separator);
 	    }
@@ -1442,7 +2851,7 @@ p_list_box_update_separator (PListBox *list_box, GSequenceIter* iter)
     {
       if (info->separator != NULL)
 	{
-	  g_hash_table_remove (priv->separator_hash, info->separator);
+	  g_object_set_qdata (G_OBJECT (info->separator), child_info_quark, NULL);
 	  gtk_widget_unparent (info->separator);
 	  g_clear_object (&info->separator);
 	  gtk_widget_queue_resize (GTK_WIDGET (list_box));
@@ -1452,121 +2861,3877 @@ p_list_box_update_separator (PListBox *list_box, GSequenceIter* iter)
     g_object_unref (before_child);
   if (child)
     g_object_unref (child);
+
+  p_list_box_update_header (list_box, iter);
 }
 
 static PListBoxChildInfo*
 p_list_box_lookup_info (PListBox *list_box, GtkWidget* child)
+{
+  PListBoxChildInfo *info;
+
+  if (gtk_widget_get_parent (child) != GTK_WIDGET (list_box))
+    return NULL;
+
+  info = g_object_get_qdata (G_OBJECT (child), child_info_quark);
+  if (info == NULL || info->widget != child)
+    return NULL;
+
+  return info;
+}
+
+static PListBoxChildInfo*
+p_list_box_lookup_separator_info (PListBox *list_box, GtkWidget* separator)
+{
+  PListBoxChildInfo *info;
+
+  if (gtk_widget_get_parent (separator) != GTK_WIDGET (list_box))
+    return NULL;
+
+  info = g_object_get_qdata (G_OBJECT (separator), child_info_quark);
+  if (info == NULL || info->separator != separator)
+    return NULL;
+
+  return info;
+}
+
+/* Updates the separators and headers around a row that was shown or
+   hidden. Filtering updates separators itself. */
+static void
+p_list_box_child_visibility_changed (GObject *object,
+				      GParamSpec *pspec,
+				      PListBox *list_box)
+{
+  PListBoxChildInfo *info;
+  gboolean visible;
+
+  info = p_list_box_lookup_info (list_box, GTK_WIDGET (object));
+  if (info == NULL)
+    return;
+
+  visible = gtk_widget_get_visible (info->widget);
+  if (visible == info->visible)
+    return;
+  info->visible = visible;
+
+  if (g_sequence_iter_get_sequence (info->iter) == list_box->priv->children &&
+      gtk_widget_get_visible (GTK_WIDGET (list_box)))
+    {
+      p_list_box_update_separator (list_box, info->iter);
+      p_list_box_update_separator (list_box,
+				   p_list_box_get_next_visible (list_box, info->iter));
+    }
+}
+
+/* Puts a new child in the sequence and parents it, but leaves the
+   separators alone. */
+static PListBoxChildInfo *
+p_list_box_insert_child (PListBox *list_box, GtkWidget *child)
 {
   PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info;
+  GSequenceIter* iter = NULL;
+
+  info = p_list_box_child_info_new (child, priv->serial++);
+  info->visible = gtk_widget_get_visible (child);
+  info->has_windows = p_list_box_widget_has_windows (child);
+  g_object_set_qdata (G_OBJECT (child), child_info_quark, info);
+  if (priv->sort_func != NULL)
+    iter = g_sequence_insert_sorted (priv->children, info,
+				     (GCompareDataFunc)do_sort, list_box);
+  else
+    iter = g_sequence_append (priv->children, info);
+  priv->rows_dirty = TRUE;
+
+  info->iter = iter;
+  gtk_widget_set_parent (child, GTK_WIDGET (list_box));
+  g_signal_connect (child, "notify::visible",
+		    G_CALLBACK (p_list_box_child_visibility_changed), list_box);
+  p_list_box_apply_filter (list_box, child);
+  p_list_box_index_row (list_box, info);
+  p_list_box_accessible_row_changed (list_box, g_sequence_iter_get_position (iter), TRUE);
+  if (info->visible)
+    p_list_box_animate_insertion (list_box, info);
 
-  return g_hash_table_lookup (priv->child_hash, child);
+  return info;
 }
 
 static void
-child_visibility_changed (GObject* object, GParamSpec* pspec, PListBox *list_box)
+p_list_box_real_add (GtkContainer* container, GtkWidget* child)
 {
+  PListBox *list_box = P_LIST_BOX (container);
   PListBoxChildInfo *info;
 
+  info = p_list_box_insert_child (list_box, child);
   if (gtk_widget_get_visible (GTK_WIDGET (list_box)))
     {
-      info = p_list_box_lookup_info (list_box, GTK_WIDGET (object));
+      p_list_box_update_separator (list_box, info->iter);
+      p_list_box_update_separator (list_box, p_list_box_get_next_visible (list_box, info->iter));
+    }
+}
+
+/* Keeps a removed row of a known type around for p_list_box_obtain_child() */
+static void
+p_list_box_park_child (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GQueue *queue;
+
+  if (info->row_type == 0 ||
+      gtk_widget_in_destruction (info->widget))
+    return;
+
+  queue = g_hash_table_lookup (priv->recycle_pool, GUINT_TO_POINTER (info->row_type));
+  if (queue == NULL)
+    {
+      queue = g_queue_new ();
+      g_hash_table_insert (priv->recycle_pool, GUINT_TO_POINTER (info->row_type), queue);
+    }
+
+  if (g_queue_get_length (queue) < priv->recycle_limit)
+    g_queue_push_head (queue, g_object_ref (info->widget));
+}
+
+static void
+p_list_box_real_remove (GtkContainer* container, GtkWidget* child)
+{
+  PListBox *list_box = P_LIST_BOX (container);
+  PListBoxPrivate *priv = list_box->priv;
+  gboolean was_visible;
+  PListBoxChildInfo *info;
+  GSequenceIter *next;
+  gboolean in_view;
+  gint position;
+
+  g_return_if_fail (child != NULL);
+  was_visible = gtk_widget_get_visible (child);
+
+  info = p_list_box_lookup_info (list_box, child);
+  if (info == NULL)
+    {
+      info = g_object_get_qdata (G_OBJECT (child), header_quark);
+      if (info != NULL && gtk_widget_get_parent (child) == GTK_WIDGET (list_box))
+	{
+	  p_list_box_drop_header (list_box, info);
+	  return;
+	}
+
+      info = p_list_box_lookup_separator_info (list_box, child);
       if (info != NULL)
 	{
-	  p_list_box_update_separator (list_box, info->iter);
-	  p_list_box_update_separator (list_box,
-					 p_list_box_get_next_visible (list_box, info->iter));
+	  g_object_set_qdata (G_OBJECT (child), child_info_quark, NULL);
+	  g_clear_object (&info->separator);
+	  gtk_widget_unparent (child);
+	  if (was_visible && gtk_widget_get_visible (GTK_WIDGET (list_box)))
+	    gtk_widget_queue_resize (GTK_WIDGET (list_box));
+	}
+      else
+	{
+	  g_warning ("egg-list-box.vala:846: Tried to remove non-child %p\n", child);
+	}
+      return;
+    }
+
+  /* A row takes its descendants along */
+  p_list_box_remove_descendants (list_box, info);
+  /* Rows below a collapsed row are not part of the list just now */
+  in_view = g_sequence_iter_get_sequence (info->iter) == priv->children;
+  if (in_view && was_visible)
+    p_list_box_animate_removal (list_box, info);
+
+  if (info->separator != NULL)
+    {
+      g_object_set_qdata (G_OBJECT (info->separator), child_info_quark, NULL);
+      gtk_widget_unparent (info->separator);
+      g_clear_object (&info->separator);
+    }
+
+  if (info == priv->selected_child)
+      p_list_box_update_selected (list_box, NULL);
+  if (info == priv->prelight_child)
+    priv->prelight_child = NULL;
+  if (info == priv->cursor_child)
+    priv->cursor_child = NULL;
+  if (info == priv->active_child)
+    priv->active_child = NULL;
+
+  next = p_list_box_get_next_visible (list_box, info->iter);
+  p_list_box_drop_header (list_box, info);
+  p_list_box_unindex_row (list_box, info);
+  p_list_box_set_row_columns (list_box, info, NULL);
+  p_list_box_unlink_tree_row (list_box, info);
+  p_list_box_forget_row_animation (list_box, info);
+  g_signal_handlers_disconnect_by_func (child, p_list_box_child_visibility_changed, list_box);
+  gtk_widget_unparent (child);
+  g_object_set_qdata (G_OBJECT (child), child_info_quark, NULL);
+  p_list_box_park_child (list_box, info);
+  position = g_sequence_iter_get_position (info->iter);
+  g_sequence_remove (info->iter);
+  if (!in_view)
+    return;
+
+  priv->rows_dirty = TRUE;
+  p_list_box_accessible_row_changed (list_box, position, FALSE);
+  if (gtk_widget_get_visible (GTK_WIDGET (list_box)))
+    p_list_box_update_separator (list_box, next);
+
+  if (was_visible && gtk_widget_get_visible (GTK_WIDGET (list_box)))
+    gtk_widget_queue_resize (GTK_WIDGET (list_box));
+}
+
+/* Unparents a child and its separator and forgets about it, without
+   doing any of the separator, selection or resize bookkeeping that
+   p_list_box_real_remove does. Bulk removal does that once at the end.
+   The caller removes info->iter from the sequence afterwards. */
+static void
+p_list_box_detach_child (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  if (info == priv->prelight_child)
+    priv->prelight_child = NULL;
+  if (info == priv->cursor_child)
+    priv->cursor_child = NULL;
+  if (info == priv->active_child)
+    priv->active_child = NULL;
+  p_list_box_drop_header (list_box, info);
+  p_list_box_unindex_row (list_box, info);
+  p_list_box_set_row_columns (list_box, info, NULL);
+  p_list_box_unlink_tree_row (list_box, info);
+  p_list_box_forget_row_animation (list_box, info);
+
+  if (info->collapsed != NULL)
+    {
+      GSequenceIter *iter;
+
+      for (iter = g_sequence_get_begin_iter (info->collapsed);
+	   !g_sequence_iter_is_end (iter);
+	   iter = g_sequence_iter_next (iter))
+	p_list_box_detach_child (list_box, g_sequence_get (iter));
+      g_sequence_free (info->collapsed);
+      info->collapsed = NULL;
+    }
+
+  if (info->widget == NULL)
+    {
+      if (priv->cell_accessibles != NULL)
+	g_hash_table_remove (priv->cell_accessibles, info);
+      if (!p_list_box_drop_tile (list_box, info) &&
+	  priv->cell_data_destroy_notify != NULL)
+	priv->cell_data_destroy_notify (info->cell_data);
+      return;
+    }
+
+  if (info->separator != NULL)
+    {
+      g_object_set_qdata (G_OBJECT (info->separator), child_info_quark, NULL);
+      gtk_widget_unparent (info->separator);
+      g_clear_object (&info->separator);
+    }
+
+  g_signal_handlers_disconnect_by_func (info->widget,
+					p_list_box_child_visibility_changed, list_box);
+  g_object_set_qdata (G_OBJECT (info->widget), child_info_quark, NULL);
+  gtk_widget_unparent (info->widget);
+  p_list_box_park_child (list_box, info);
+}
+
+/**
+ * p_list_box_remove_all:
+ * @self: a #PListBox
+ *
+ * Removes all children from the list in one pass. This is much faster
+ * than calling gtk_container_remove() on every child, as separators
+ * are not updated and no resize is queued for each removed row.
+ *
+ * Note that the #GtkContainer::remove signal is not emitted for the
+ * removed children.
+ */
+void
+p_list_box_remove_all (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GSequenceIter *iter;
+  gboolean had_selection, had_cell_selection;
+  gint position;
+
+  g_return_if_fail (list_box != NULL);
+
+  if (g_sequence_get_length (priv->children) == 0)
+    return;
+
+  had_selection = priv->selected_child != NULL;
+  had_cell_selection = had_selection && priv->selected_child->widget == NULL;
+  priv->selected_child = NULL;
+
+  for (iter = g_sequence_get_begin_iter (priv->children);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    p_list_box_detach_child (list_box, g_sequence_get (iter));
+
+  position = g_sequence_get_length (priv->children);
+  g_sequence_remove_range (g_sequence_get_begin_iter (priv->children),
+			   g_sequence_get_end_iter (priv->children));
+  priv->rows_dirty = TRUE;
+  /* Last to first, so each index is valid when it is reported */
+  while (position-- > 0)
+    p_list_box_accessible_row_changed (list_box, position, FALSE);
+
+  /* Like p_list_box_update_selected(), once the rows are gone */
+  if (had_selection)
+    g_signal_emit (list_box, signals[CHILD_SELECTED], 0, NULL);
+  if (had_cell_selection)
+    g_signal_emit (list_box, signals[CELL_SELECTED], 0, NULL);
+
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+}
+
+/* Removes the matching rows collapsed below a row. Returns TRUE if
+   the selected row went. */
+static gboolean
+p_list_box_remove_matching_collapsed (PListBox *list_box,
+				       PListBoxChildInfo *parent,
+				       PListBoxFilterFunc predicate,
+				       void *predicate_target)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info;
+  GSequenceIter *iter, *next;
+  gboolean lost_selection;
+  guint cut_depth;
+
+  lost_selection = FALSE;
+  cut_depth = G_MAXUINT;
+  iter = g_sequence_get_begin_iter (parent->collapsed);
+  while (!g_sequence_iter_is_end (iter))
+    {
+      info = g_sequence_get (iter);
+      next = g_sequence_iter_next (iter);
+
+      if (info->depth <= cut_depth)
+	cut_depth = G_MAXUINT;
+      if (info->widget != NULL &&
+	  (cut_depth != G_MAXUINT || predicate (info->widget, predicate_target)))
+	{
+	  if (cut_depth == G_MAXUINT)
+	    cut_depth = info->depth;
+	  if (info == priv->selected_child)
+	    {
+	      priv->selected_child = NULL;
+	      lost_selection = TRUE;
+	    }
+	  p_list_box_detach_child (list_box, info);
+	  g_sequence_remove (iter);
 	}
+      else if (info->collapsed != NULL &&
+	       p_list_box_remove_matching_collapsed (list_box, info,
+						     predicate, predicate_target))
+	lost_selection = TRUE;
+
+      iter = next;
     }
+
+  return lost_selection;
+}
+
+/**
+ * p_list_box_remove_matching:
+ * @self: a #PListBox
+ * @predicate: (scope call) (closure predicate_target): function deciding
+ *   which children to remove
+ * @predicate_target: (allow-none): user data for @predicate
+ *
+ * Removes every child for which @predicate returns %TRUE, in a single
+ * pass over the list. Separators are only updated for the rows that
+ * end up following a removed run, and a single resize is queued at the
+ * end. @predicate must not modify the list.
+ *
+ * Note that the #GtkContainer::remove signal is not emitted for the
+ * removed children.
+ */
+void
+p_list_box_remove_matching (PListBox *list_box,
+			     PListBoxFilterFunc predicate,
+			     void *predicate_target)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info;
+  GSequenceIter *iter, *next;
+  GPtrArray *reseparate;
+  gboolean removed_any;
+  gboolean prev_removed;
+  gboolean lost_selection;
+  gint position;
+  guint cut_depth;
+  guint i;
+
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (predicate != NULL);
+
+  reseparate = g_ptr_array_new ();
+  removed_any = FALSE;
+  prev_removed = FALSE;
+  lost_selection = FALSE;
+  position = 0;
+  cut_depth = G_MAXUINT;
+
+  iter = g_sequence_get_begin_iter (priv->children);
+  while (!g_sequence_iter_is_end (iter))
+    {
+      info = g_sequence_get (iter);
+      next = g_sequence_iter_next (iter);
+
+      /* Descendants of a removed row go too */
+      if (info->depth <= cut_depth)
+	cut_depth = G_MAXUINT;
+      if (info->widget != NULL &&
+	  (cut_depth != G_MAXUINT || predicate (info->widget, predicate_target)))
+	{
+	  if (cut_depth == G_MAXUINT)
+	    cut_depth = info->depth;
+	  if (info == priv->selected_child)
+	    {
+	      priv->selected_child = NULL;
+	      lost_selection = TRUE;
+	    }
+	  p_list_box_detach_child (list_box, info);
+	  g_sequence_remove (iter);
+	  priv->rows_dirty = TRUE;
+	  p_list_box_accessible_row_changed (list_box, position, FALSE);
+	  removed_any = TRUE;
+	  prev_removed = TRUE;
+	  iter = next;
+	  continue;
+	}
+
+      if (info->collapsed != NULL &&
+	  p_list_box_remove_matching_collapsed (list_box, info,
+						predicate, predicate_target))
+	lost_selection = TRUE;
+
+      position++;
+      if (prev_removed && child_info_is_visible (info))
+	{
+	  /* The previous visible row of this one went away */
+	  g_ptr_array_add (reseparate, iter);
+	  prev_removed = FALSE;
+	}
+
+      iter = next;
+    }
+
+  if (gtk_widget_get_visible (GTK_WIDGET (list_box)))
+    {
+      for (i = 0; i < reseparate->len; i++)
+	p_list_box_update_separator (list_box, g_ptr_array_index (reseparate, i));
+    }
+  g_ptr_array_free (reseparate, TRUE);
+
+  if (lost_selection)
+    g_signal_emit (list_box, signals[CHILD_SELECTED], 0, NULL);
+
+  if (removed_any)
+    gtk_widget_queue_resize (GTK_WIDGET (list_box));
+}
+
+
+/**
+ * p_list_box_set_child_row_type:
+ * @self: a #PListBox
+ * @child: a child of @self
+ * @row_type: (allow-none): a tag identifying rows built the same way, or %NULL
+ *
+ * Tags @child with a row type. When a tagged child is removed from the
+ * list it is not destroyed but parked in a per-type pool, from which it
+ * can be handed back by p_list_box_obtain_child() to be rebound to new
+ * data instead of constructing a new widget tree.
+ */
+void
+p_list_box_set_child_row_type (PListBox *list_box,
+				GtkWidget *child,
+				const gchar *row_type)
+{
+  PListBoxChildInfo *info;
+
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (child != NULL);
+
+  info = p_list_box_lookup_info (list_box, child);
+  if (info == NULL)
+    return;
+
+  info->row_type = row_type != NULL ? g_quark_from_string (row_type) : 0;
+}
+
+/**
+ * p_list_box_obtain_child:
+ * @self: a #PListBox
+ * @row_type: the row type to look for
+ *
+ * Takes a previously removed child of type @row_type out of the
+ * recycling pool. The returned widget has a floating reference, just
+ * like a newly constructed one, so it can be rebound and passed to
+ * gtk_container_add() directly. The row type tag is not kept, call
+ * p_list_box_set_child_row_type() again after adding it.
+ *
+ * Return value: (transfer full) (allow-none): a parked #GtkWidget, or
+ * %NULL if the pool for @row_type is empty.
+ */
+GtkWidget *
+p_list_box_obtain_child (PListBox *list_box,
+			  const gchar *row_type)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GtkWidget *widget;
+  GQueue *queue;
+  GQuark quark;
+
+  g_return_val_if_fail (list_box != NULL, NULL);
+  g_return_val_if_fail (row_type != NULL, NULL);
+
+  quark = g_quark_try_string (row_type);
+  if (quark == 0)
+    return NULL;
+
+  queue = g_hash_table_lookup (priv->recycle_pool, GUINT_TO_POINTER (quark));
+  if (queue == NULL)
+    return NULL;
+
+  widget = g_queue_pop_head (queue);
+  if (widget != NULL)
+    g_object_force_floating (G_OBJECT (widget));
+
+  return widget;
+}
+
+/**
+ * p_list_box_set_recycle_limit:
+ * @self: a #PListBox
+ * @limit: the maximum number of parked rows per row type
+ *
+ * Sets how many removed rows of each row type are kept for reuse.
+ * Rows beyond the limit are destroyed when removed. Setting a lower
+ * limit trims the pools right away.
+ */
+void
+p_list_box_set_recycle_limit (PListBox *list_box,
+			       guint limit)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GHashTableIter iter;
+  GQueue *queue;
+
+  g_return_if_fail (list_box != NULL);
+
+  priv->recycle_limit = limit;
+
+  g_hash_table_iter_init (&iter, priv->recycle_pool);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &queue))
+    {
+      while (g_queue_get_length (queue) > limit)
+	g_object_unref (g_queue_pop_tail (queue));
+    }
+}
+
+/**
+ * p_list_box_trim_recycled:
+ * @self: a #PListBox
+ *
+ * Destroys all rows parked for reuse. This happens automatically when
+ * the list is unrealized; applications can also call it when they are
+ * running low on memory.
+ */
+void
+p_list_box_trim_recycled (PListBox *list_box)
+{
+  g_return_if_fail (list_box != NULL);
+
+  g_hash_table_remove_all (list_box->priv->recycle_pool);
+}
+
+/* Takes the whole producer stack in one atomic step */
+static PListBoxFeedItem *
+p_list_box_feed_steal (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxFeedItem *head;
+
+  do
+    head = g_atomic_pointer_get (&priv->feed_head);
+  while (!g_atomic_pointer_compare_and_exchange (&priv->feed_head, head, NULL));
+
+  return head;
+}
+
+/* Appends everything pushed so far to the backlog, in push order */
+static void
+p_list_box_feed_collect (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxFeedItem *head, *tail, *reversed, *next;
+
+  head = p_list_box_feed_steal (list_box);
+  if (head == NULL)
+    return;
+
+  tail = head;
+  reversed = NULL;
+  while (head != NULL)
+    {
+      next = head->next;
+      head->next = reversed;
+      reversed = head;
+      head = next;
+    }
+
+  if (priv->feed_pending_tail != NULL)
+    priv->feed_pending_tail->next = reversed;
+  else
+    priv->feed_pending = reversed;
+  priv->feed_pending_tail = tail;
+}
+
+static void
+p_list_box_feed_free_items (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxFeedItem *feed_item;
+
+  p_list_box_feed_collect (list_box);
+
+  while (priv->feed_pending != NULL)
+    {
+      feed_item = priv->feed_pending;
+      priv->feed_pending = feed_item->next;
+      if (priv->item_destroy_notify != NULL)
+	priv->item_destroy_notify (feed_item->item);
+      g_slice_free (PListBoxFeedItem, feed_item);
+    }
+  priv->feed_pending_tail = NULL;
+}
+
+/* Turns pending items into rows until the time budget is used up.
+   Separators and the resize are handled once for the whole batch.
+   Returns TRUE if there is more to do. */
+static gboolean
+p_list_box_feed_drain (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxFeedItem *feed_item;
+  PListBoxChildInfo *info;
+  GtkWidget *child;
+  GPtrArray *added;
+  gint64 deadline;
+  guint i, n;
+
+  p_list_box_feed_collect (list_box);
+
+  /* Items wait until there is a factory */
+  if (priv->create_child_func == NULL)
+    return FALSE;
+
+  added = g_ptr_array_new ();
+  deadline = g_get_monotonic_time () + priv->feed_budget;
+  n = 0;
+
+  while (priv->feed_pending != NULL)
+    {
+      feed_item = priv->feed_pending;
+      priv->feed_pending = feed_item->next;
+      if (priv->feed_pending == NULL)
+	priv->feed_pending_tail = NULL;
+
+      child = priv->create_child_func (feed_item->item, priv->create_child_func_target);
+      g_slice_free (PListBoxFeedItem, feed_item);
+
+      if (child != NULL)
+	{
+	  info = p_list_box_insert_child (list_box, child);
+	  g_ptr_array_add (added, info);
+	}
+
+      /* Reading the clock is not free, only look every few rows */
+      if ((++n % 16) == 0 && g_get_monotonic_time () >= deadline)
+	break;
+    }
+
+  if (added->len > 0)
+    {
+      if (priv->update_separator_func != NULL &&
+	  gtk_widget_get_visible (GTK_WIDGET (list_box)))
+	{
+	  for (i = 0; i < added->len; i++)
+	    {
+	      info = g_ptr_array_index (added, i);
+	      p_list_box_update_separator (list_box, info->iter);
+	      p_list_box_update_separator (list_box, p_list_box_get_next_visible (list_box, info->iter));
+	    }
+	}
+      gtk_widget_queue_resize (GTK_WIDGET (list_box));
+    }
+  g_ptr_array_free (added, TRUE);
+
+  return priv->feed_pending != NULL ||
+    g_atomic_pointer_get (&priv->feed_head) != NULL;
+}
+
+/* Called once the backlog is empty. Lets producers wake us up again,
+   unless one of them pushed something while we were finishing. */
+static gboolean
+p_list_box_feed_finish (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  g_atomic_int_set (&priv->feed_scheduled, 0);
+
+  return g_atomic_pointer_get (&priv->feed_head) != NULL &&
+    g_atomic_int_compare_and_exchange (&priv->feed_scheduled, 0, 1);
+}
+
+static gboolean
+p_list_box_feed_tick (GtkWidget *widget,
+		       GdkFrameClock *frame_clock,
+		       gpointer user_data)
+{
+  PListBox *list_box = P_LIST_BOX (widget);
+  PListBoxPrivate *priv = list_box->priv;
+
+  if (p_list_box_feed_drain (list_box) ||
+      p_list_box_feed_finish (list_box))
+    return TRUE;
+
+  priv->feed_tick_id = 0;
+  return FALSE;
+}
+
+static gboolean
+p_list_box_feed_wakeup (gpointer user_data)
+{
+  PListBox *list_box = P_LIST_BOX (user_data);
+  PListBoxPrivate *priv = list_box->priv;
+
+  /* Pace ourselves on the frame clock when we have one */
+  if (gtk_widget_get_realized (GTK_WIDGET (list_box)))
+    {
+      if (priv->feed_tick_id == 0)
+	priv->feed_tick_id =
+	  gtk_widget_add_tick_callback (GTK_WIDGET (list_box),
+					p_list_box_feed_tick, NULL, NULL);
+      return FALSE;
+    }
+
+  return p_list_box_feed_drain (list_box) ||
+    p_list_box_feed_finish (list_box);
+}
+
+/* Safe to call from any thread. Only one wakeup is ever outstanding. */
+static void
+p_list_box_feed_schedule (PListBox *list_box)
+{
+  g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, p_list_box_feed_wakeup,
+		   g_object_ref (list_box), g_object_unref);
+}
+
+/**
+ * p_list_box_set_child_factory:
+ * @self: a #PListBox
+ * @create_child: (closure create_child_target): function creating a row
+ *   widget for an item passed to p_list_box_push_item()
+ * @create_child_target: (allow-none): user data for @create_child
+ * @create_child_target_destroy_notify: (allow-none): destroys @create_child_target
+ * @item_destroy_notify: (allow-none): frees items that never reached
+ *   @create_child
+ *
+ * Sets the function used to turn pushed items into rows. It is called on
+ * the main thread, takes ownership of the item and must return a shown
+ * widget, or %NULL to skip the item. It must not modify the list.
+ */
+void
+p_list_box_set_child_factory (PListBox *list_box,
+			       PListBoxCreateChildFunc create_child,
+			       void *create_child_target,
+			       GDestroyNotify create_child_target_destroy_notify,
+			       GDestroyNotify item_destroy_notify)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  g_return_if_fail (list_box != NULL);
+
+  if (priv->create_child_func_target_destroy_notify != NULL)
+    priv->create_child_func_target_destroy_notify (priv->create_child_func_target);
+
+  priv->create_child_func = create_child;
+  priv->create_child_func_target = create_child_target;
+  priv->create_child_func_target_destroy_notify = create_child_target_destroy_notify;
+  priv->item_destroy_notify = item_destroy_notify;
+
+  if (create_child != NULL && priv->feed_pending != NULL &&
+      g_atomic_int_compare_and_exchange (&priv->feed_scheduled, 0, 1))
+    p_list_box_feed_schedule (list_box);
+}
+
+/**
+ * p_list_box_push_item:
+ * @self: a #PListBox
+ * @item: the data for a new row
+ *
+ * Queues @item to be turned into a row by the child factory. This can
+ * be called from any thread, as long as the caller keeps @self alive.
+ * Items are handed over without locking; the main thread picks them
+ * up on the next frame and adds as many rows as fit in the feed
+ * budget, in push order, with a single resize per batch.
+ */
+void
+p_list_box_push_item (PListBox *list_box,
+		       gpointer item)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxFeedItem *feed_item, *head;
+
+  g_return_if_fail (list_box != NULL);
+
+  feed_item = g_slice_new (PListBoxFeedItem);
+  feed_item->item = item;
+
+  do
+    {
+      head = g_atomic_pointer_get (&priv->feed_head);
+      feed_item->next = head;
+    }
+  while (!g_atomic_pointer_compare_and_exchange (&priv->feed_head, head, feed_item));
+
+  if (g_atomic_int_compare_and_exchange (&priv->feed_scheduled, 0, 1))
+    p_list_box_feed_schedule (list_box);
+}
+
+/**
+ * p_list_box_set_feed_budget:
+ * @self: a #PListBox
+ * @budget_usec: time in microseconds
+ *
+ * Sets how much time per frame may be spent creating rows for pushed
+ * items.
+ */
+void
+p_list_box_set_feed_budget (PListBox *list_box,
+			     guint budget_usec)
+{
+  g_return_if_fail (list_box != NULL);
+
+  list_box->priv->feed_budget = budget_usec;
+}
+
+static void
+p_list_box_render_target_unref (PListBoxRenderTarget *holder)
+{
+  if (holder == NULL || --holder->ref_count > 0)
+    return;
+
+  if (holder->target_destroy_notify != NULL)
+    holder->target_destroy_notify (holder->target);
+  g_slice_free (PListBoxRenderTarget, holder);
+}
+
+static void
+p_list_box_tile_free (PListBoxTile *tile)
+{
+  if (tile == NULL)
+    return;
+
+  if (tile->surface != NULL)
+    cairo_surface_destroy (tile->surface);
+  g_slice_free (PListBoxTile, tile);
+}
+
+/* Forgets the rendered surface, but keeps the tile */
+static void
+p_list_box_tile_clear (PListBox *list_box, PListBoxTile *tile)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  if (tile->link != NULL)
+    {
+      g_queue_delete_link (priv->tiles, tile->link);
+      tile->link = NULL;
+    }
+  if (tile->surface != NULL)
+    {
+      cairo_surface_destroy (tile->surface);
+      tile->surface = NULL;
+    }
+}
+
+/* The cell changed, anything rendered or being rendered is stale */
+static void
+p_list_box_invalidate_tile (PListBox *list_box, PListBoxChildInfo *info)
+{
+  if (info->tile == NULL)
+    return;
+
+  p_list_box_tile_clear (list_box, info->tile);
+  info->tile->generation++;
+}
+
+/* Called when a cell goes away. Returns TRUE if a worker still reads
+   its data, in which case freeing the data is left to the job. */
+static gboolean
+p_list_box_drop_tile (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxTile *tile = info->tile;
+  gboolean in_use = FALSE;
+
+  if (tile == NULL)
+    return FALSE;
+
+  p_list_box_tile_clear (list_box, tile);
+  if (tile->job != NULL)
+    {
+      tile->job->info = NULL;
+      /* After p_list_box_cell_set_data() the job reads older data,
+         which it frees already */
+      if (tile->job->cell_data == info->cell_data)
+	{
+	  tile->job->free_cell_data = priv->cell_data_destroy_notify;
+	  in_use = TRUE;
+	}
+    }
+  p_list_box_tile_free (tile);
+  info->tile = NULL;
+
+  return in_use;
+}
+
+static void
+p_list_box_trim_tiles (PListBox *list_box, guint limit)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info;
+
+  while (g_queue_get_length (priv->tiles) > limit)
+    {
+      info = g_queue_peek_tail (priv->tiles);
+      p_list_box_tile_clear (list_box, info->tile);
+    }
+}
+
+/* Takes finished jobs back on the main thread. There is one wakeup for
+   whatever finished since the last one, not one per tile. */
+static gboolean
+p_list_box_render_done (gpointer user_data)
+{
+  PListBox *list_box = P_LIST_BOX (user_data);
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxRenderJob *job;
+  PListBoxTile *tile;
+  GSList *done, *l;
+
+  g_mutex_lock (&priv->render_lock);
+  done = priv->render_done;
+  priv->render_done = NULL;
+  priv->render_idle_id = 0;
+  g_mutex_unlock (&priv->render_lock);
+
+  for (l = done; l != NULL; l = l->next)
+    {
+      job = l->data;
+      priv->render_jobs--;
+
+      if (job->info != NULL)
+	{
+	  tile = job->info->tile;
+	  tile->job = NULL;
+	  /* Tiles rendered with old column widths are dropped too */
+	  if (job->generation == tile->generation &&
+	      job->columns_serial == priv->columns_serial)
+	    {
+	      p_list_box_tile_clear (list_box, tile);
+	      tile->surface = job->surface;
+	      tile->width = job->width;
+	      tile->height = job->height;
+	      tile->scale = job->scale;
+	      g_queue_push_head (priv->tiles, job->info);
+	      tile->link = priv->tiles->head;
+	      job->surface = NULL;
+	    }
+	  /* Also when stale, so a fresh tile gets requested */
+	  gtk_widget_queue_draw_area (GTK_WIDGET (list_box),
+				      0, row_get_y (list_box, job->info),
+				      gtk_widget_get_allocated_width (GTK_WIDGET (list_box)),
+				      row_get_height (list_box, job->info));
+	}
+
+      if (job->free_cell_data != NULL)
+	job->free_cell_data (job->cell_data);
+      if (job->surface != NULL)
+	cairo_surface_destroy (job->surface);
+      p_list_box_render_target_unref (job->render_target);
+      g_free (job->column_widths);
+      g_object_unref (job->list_box);
+      g_slice_free (PListBoxRenderJob, job);
+    }
+  g_slist_free (done);
+
+  p_list_box_trim_tiles (list_box, priv->tile_limit);
+
+  return FALSE;
+}
+
+/* The job being rendered on the current worker thread */
+static GPrivate render_job_key;
+
+/* Runs on a worker thread */
+static void
+p_list_box_render_tile (gpointer data, gpointer user_data)
+{
+  PListBoxRenderJob *job = data;
+  PListBoxPrivate *priv = job->list_box->priv;
+  cairo_t *cr;
+
+  job->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+					     job->width * job->scale,
+					     job->height * job->scale);
+#ifdef HAVE_TILE_SCALE
+  cairo_surface_set_device_scale (job->surface, job->scale, job->scale);
+#endif
+  cr = cairo_create (job->surface);
+  g_private_set (&render_job_key, job);
+  job->render (job->list_box, job->cell_data, cr, job->width, job->height,
+	       job->render_target->target);
+  g_private_set (&render_job_key, NULL);
+  cairo_destroy (cr);
+  cairo_surface_flush (job->surface);
+
+  g_mutex_lock (&priv->render_lock);
+  priv->render_done = g_slist_prepend (priv->render_done, job);
+  if (priv->render_idle_id == 0)
+    priv->render_idle_id = g_idle_add_full (G_PRIORITY_DEFAULT, p_list_box_render_done,
+					    g_object_ref (job->list_box), g_object_unref);
+  g_mutex_unlock (&priv->render_lock);
+}
+
+static void
+p_list_box_request_tile (PListBox *list_box,
+			  PListBoxChildInfo *info,
+			  gint width,
+			  gint height)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxRenderJob *job;
+  PListBoxTile *tile;
+  gint scale;
+
+  if (width <= 0 || height <= 0)
+    return;
+
+#ifdef HAVE_TILE_SCALE
+  scale = gtk_widget_get_scale_factor (GTK_WIDGET (list_box));
+#else
+  scale = 1;
+#endif
+
+  if (info->tile == NULL)
+    info->tile = g_slice_new0 (PListBoxTile);
+  tile = info->tile;
+
+  if (tile->job != NULL ||
+      (tile->surface != NULL && tile->width == width && tile->height == height &&
+       tile->scale == scale))
+    return;
+
+  if (priv->render_pool == NULL)
+    priv->render_pool = g_thread_pool_new (p_list_box_render_tile, NULL,
+					   g_get_num_processors (), FALSE, NULL);
+
+  job = g_slice_new0 (PListBoxRenderJob);
+  job->list_box = g_object_ref (list_box);
+  job->render = priv->cell_funcs.render;
+  job->render_target = priv->cell_funcs_holder;
+  job->render_target->ref_count++;
+  job->cell_data = info->cell_data;
+  job->width = width;
+  job->height = height;
+  job->scale = scale;
+  job->generation = tile->generation;
+  if (priv->n_columns > 0)
+    job->column_widths = g_memdup (priv->column_max, priv->n_columns * sizeof (gint));
+  job->n_columns = priv->n_columns;
+  job->columns_serial = priv->columns_serial;
+  job->info = info;
+  tile->job = job;
+  priv->render_jobs++;
+
+  g_thread_pool_push (priv->render_pool, job, NULL);
+}
+
+/* Paints the tile of a cell, asking for it first if needed. A tile of
+   the wrong size is still shown until the new one is there. Returns
+   FALSE if there is nothing to paint yet. */
+static gboolean
+p_list_box_draw_tile (PListBox *list_box,
+		       PListBoxChildInfo *info,
+		       cairo_t *cr,
+		       gint width,
+		       gint height)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxTile *tile;
+
+  p_list_box_request_tile (list_box, info, width, height);
+
+  tile = info->tile;
+  if (tile == NULL || tile->surface == NULL)
+    return FALSE;
+
+  /* Keep what is in view at the front */
+  g_queue_unlink (priv->tiles, tile->link);
+  g_queue_push_head_link (priv->tiles, tile->link);
+
+  cairo_set_source_surface (cr, tile->surface, 0, 0);
+  cairo_paint (cr);
+
+  return TRUE;
+}
+
+/* Gets tiles going for the cells the view is scrolling towards, up to
+   a page ahead, nearest first */
+static void
+p_list_box_prefetch_tiles (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info;
+  GtkAllocation allocation;
+  gdouble value;
+  gboolean down;
+  gint view_start, view_end;
+  gint start, end;
+  gint focus;
+  gint x, width;
+  guint max_jobs;
+  guint first, last, i, n;
+
+  if (priv->cell_funcs.render == NULL || priv->adjustment == NULL)
+    return;
+
+  value = gtk_adjustment_get_value (priv->adjustment);
+  if (value == priv->last_scroll_value)
+    return;
+  down = value > priv->last_scroll_value;
+  priv->last_scroll_value = value;
+
+  gtk_widget_get_allocation (GTK_WIDGET (list_box), &allocation);
+  if (!p_list_box_get_view_range (list_box, &allocation, &view_start, &view_end))
+    return;
+
+  start = down ? view_end : view_start - (view_end - view_start);
+  end = down ? view_end + (view_end - view_start) : view_start;
+
+  /* Don't let a flick bury the rows in view under prefetches */
+  max_jobs = 2 * g_get_num_processors ();
+  if (priv->render_jobs >= max_jobs)
+    return;
+
+  focus = p_list_box_get_focus_size (list_box);
+  first = p_list_box_bisect_rows (list_box, start);
+  for (last = first; last < priv->n_rows && priv->row_y[last] < end; last++)
+    ;
+
+  for (i = 0; i < last - first && priv->render_jobs < max_jobs; i++)
+    {
+      n = down ? first + i : last - 1 - i;
+      info = priv->row_info[n];
+      if (info->widget != NULL)
+	continue;
+      p_list_box_get_row_span (list_box, n, allocation.width, &x, &width);
+      p_list_box_request_tile (list_box, info,
+			       width - 2 * focus,
+			       priv->row_height[n] - 2 * focus);
+    }
+}
+
+/**
+ * p_list_box_set_tile_limit:
+ * @self: a #PListBox
+ * @limit: the number of tiles
+ *
+ * Sets how many rendered cell tiles are kept. The ones drawn least
+ * recently are dropped first.
+ */
+void
+p_list_box_set_tile_limit (PListBox *list_box,
+			    guint limit)
+{
+  g_return_if_fail (list_box != NULL);
+
+  list_box->priv->tile_limit = limit;
+  p_list_box_trim_tiles (list_box, limit);
+}
+
+/**
+ * p_list_box_set_cell_funcs:
+ * @self: a #PListBox
+ * @funcs: the callbacks used for all cells of @self
+ * @funcs_target: (allow-none): user data for @funcs
+ * @funcs_target_destroy_notify: (allow-none): destroys @funcs_target
+ * @cell_data_destroy_notify: (allow-none): frees the data of removed cells
+ *
+ * Sets how cells, the draw-only rows added with p_list_box_add_cell(),
+ * are measured, drawn and hit tested. @funcs is copied.
+ *
+ * If @funcs has a render function, cells are rendered into image
+ * surfaces on a pool of worker threads instead, and the main thread
+ * only paints the finished tiles. Tiles are requested when a cell is
+ * drawn and, while scrolling, for the page ahead. Until a tile is
+ * ready the draw function, if set, is used as placeholder. The render
+ * function must only read the cell data and @funcs_target, and may
+ * call p_list_box_get_column_width(). If the funcs are replaced while
+ * renders are in flight, @funcs_target is only destroyed once they
+ * are done.
+ *
+ * The describe function, if set, returns a newly allocated text that
+ * assistive technologies read out for a cell. It is only called for
+ * cells a client asks about, and for type-ahead once text is typed.
+ */
+void
+p_list_box_set_cell_funcs (PListBox *list_box,
+			    const PListBoxCellFuncs *funcs,
+			    void *funcs_target,
+			    GDestroyNotify funcs_target_destroy_notify,
+			    GDestroyNotify cell_data_destroy_notify)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GSequenceIter *iter;
+  PListBoxChildInfo *info;
+
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (funcs != NULL);
+
+  p_list_box_render_target_unref (priv->cell_funcs_holder);
+
+  priv->cell_funcs = *funcs;
+  priv->cell_funcs_target = funcs_target;
+  priv->cell_funcs_holder = g_slice_new (PListBoxRenderTarget);
+  priv->cell_funcs_holder->ref_count = 1;
+  priv->cell_funcs_holder->target = funcs_target;
+  priv->cell_funcs_holder->target_destroy_notify = funcs_target_destroy_notify;
+  priv->cell_data_destroy_notify = cell_data_destroy_notify;
+
+  for (iter = g_sequence_get_begin_iter (priv->children);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      info = g_sequence_get (iter);
+      info->cell_width = -1;
+      p_list_box_invalidate_tile (list_box, info);
+    }
+  p_list_box_reindex (list_box);
+
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+}
+
+/**
+ * p_list_box_set_cell_data_destroy_notify:
+ * @self: a #PListBox
+ * @cell_data_destroy_notify: (allow-none): frees the data of removed cells
+ *
+ * Sets how the data of removed cells is freed, without touching the
+ * cell funcs. Data a worker still renders is freed once it is done.
+ */
+void
+p_list_box_set_cell_data_destroy_notify (PListBox *list_box,
+					  GDestroyNotify cell_data_destroy_notify)
+{
+  g_return_if_fail (list_box != NULL);
+
+  list_box->priv->cell_data_destroy_notify = cell_data_destroy_notify;
+}
+
+/**
+ * p_list_box_add_cell:
+ * @self: a #PListBox
+ * @cell_data: the data to draw
+ *
+ * Adds a draw-only row. Cells have no #GtkWidget, they are measured
+ * and drawn by the callbacks set with p_list_box_set_cell_funcs(),
+ * which keeps each of them down to a few dozen bytes. They can be
+ * mixed with ordinary children, but are never filtered, get no
+ * separator, and are kept after all widget rows, in the order they
+ * were added, when a sort function is set.
+ *
+ * Return value: (transfer none): a handle for the new cell, valid
+ * until it is removed.
+ */
+PListBoxCell *
+p_list_box_add_cell (PListBox *list_box,
+		      gpointer cell_data)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info;
+
+  g_return_val_if_fail (list_box != NULL, NULL);
+
+  info = p_list_box_cell_info_new (cell_data, priv->serial++);
+  if (priv->sort_func != NULL || priv->cell_sort_func != NULL)
+    info->iter = g_sequence_insert_sorted (priv->children, info,
+					   (GCompareDataFunc)do_sort, list_box);
+  else
+    info->iter = g_sequence_append (priv->children, info);
+  priv->rows_dirty = TRUE;
+  p_list_box_index_row (list_box, info);
+  p_list_box_accessible_row_changed (list_box, g_sequence_iter_get_position (info->iter), TRUE);
+  p_list_box_animate_insertion (list_box, info);
+
+  if (gtk_widget_get_visible (GTK_WIDGET (list_box)))
+    p_list_box_update_separator (list_box, p_list_box_get_next_visible (list_box, info->iter));
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+
+  return (PListBoxCell *) info;
+}
+
+/**
+ * p_list_box_remove_cell:
+ * @self: a #PListBox
+ * @cell: a cell of @self
+ *
+ * Removes a cell added with p_list_box_add_cell() and frees its data.
+ */
+void
+p_list_box_remove_cell (PListBox *list_box,
+			 PListBoxCell *cell)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info = (PListBoxChildInfo *) cell;
+  GSequenceIter *next;
+  gint position;
+
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (cell != NULL);
+
+  if (info == priv->selected_child)
+    p_list_box_update_selected (list_box, NULL);
+
+  next = p_list_box_get_next_visible (list_box, info->iter);
+  position = g_sequence_iter_get_position (info->iter);
+  p_list_box_animate_removal (list_box, info);
+  p_list_box_detach_child (list_box, info);
+  g_sequence_remove (info->iter);
+  priv->rows_dirty = TRUE;
+  p_list_box_accessible_row_changed (list_box, position, FALSE);
+  if (gtk_widget_get_visible (GTK_WIDGET (list_box)))
+    {
+      p_list_box_update_separator (list_box, next);
+      gtk_widget_queue_resize (GTK_WIDGET (list_box));
+    }
+}
+
+/**
+ * p_list_box_cell_changed:
+ * @self: a #PListBox
+ * @cell: a cell of @self
+ *
+ * Tells @self that the data of @cell changed, so it has to be
+ * measured and drawn again.
+ */
+void
+p_list_box_cell_changed (PListBox *list_box,
+			  PListBoxCell *cell)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info = (PListBoxChildInfo *) cell;
+  PListBoxCellAccessible *accessible;
+  gint position;
+
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (cell != NULL);
+
+  if (priv->cell_sort_func != NULL)
+    {
+      position = g_sequence_iter_get_position (info->iter);
+      g_sequence_sort_changed (info->iter, (GCompareDataFunc)do_sort, list_box);
+      if (g_sequence_iter_get_position (info->iter) != position)
+	{
+	  priv->rows_dirty = TRUE;
+	  p_list_box_accessible_row_changed (list_box, position, FALSE);
+	  p_list_box_accessible_row_changed (list_box, g_sequence_iter_get_position (info->iter), TRUE);
+	}
+    }
+
+  info->cell_width = -1;
+  p_list_box_invalidate_tile (list_box, info);
+  p_list_box_index_row (list_box, info);
+  if (list_box->priv->cell_accessibles != NULL)
+    {
+      accessible = g_hash_table_lookup (list_box->priv->cell_accessibles, info);
+      if (accessible != NULL)
+	p_list_box_cell_accessible_update_name (accessible);
+    }
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+}
+
+/**
+ * p_list_box_cell_set_data:
+ * @self: a #PListBox
+ * @cell: a cell of @self
+ * @cell_data: the new data
+ *
+ * Replaces the data of @cell, freeing the old data. Cells that are
+ * rendered on worker threads must not have their data modified in
+ * place, use this instead. The old data is only freed once no worker
+ * reads it anymore.
+ */
+void
+p_list_box_cell_set_data (PListBox *list_box,
+			   PListBoxCell *cell,
+			   gpointer cell_data)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info = (PListBoxChildInfo *) cell;
+
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (cell != NULL);
+
+  if (info->tile != NULL && info->tile->job != NULL &&
+      info->tile->job->cell_data == info->cell_data)
+    info->tile->job->free_cell_data = priv->cell_data_destroy_notify;
+  else if (priv->cell_data_destroy_notify != NULL)
+    priv->cell_data_destroy_notify (info->cell_data);
+
+  info->cell_data = cell_data;
+  p_list_box_cell_changed (list_box, cell);
+}
+
+/**
+ * p_list_box_cell_get_data:
+ * @cell: a cell
+ *
+ * Return value: (transfer none): the data @cell was added with.
+ */
+gpointer
+p_list_box_cell_get_data (PListBoxCell *cell)
+{
+  g_return_val_if_fail (cell != NULL, NULL);
+
+  return ((PListBoxChildInfo *) cell)->cell_data;
+}
+
+/**
+ * p_list_box_set_cell_sort_func:
+ * @self: An #PListBox.
+ * @f: Compares the data of two cells.
+ * @f_target: Data for @f.
+ * @f_target_destroy_notify: Frees @f_target.
+ *
+ * Sets how cells are ordered, instead of the order they were added
+ * in. Cells always follow the widget rows. A cell that changed is
+ * moved when p_list_box_cell_changed() is called for it.
+ **/
+void
+p_list_box_set_cell_sort_func (PListBox *list_box,
+				PListBoxCellSortFunc f,
+				void *f_target,
+				GDestroyNotify f_target_destroy_notify)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GSequenceIter *iter, *next;
+  GSequence *cells;
+
+  g_return_if_fail (list_box != NULL);
+
+  if (priv->cell_sort_func_target_destroy_notify != NULL)
+    priv->cell_sort_func_target_destroy_notify (priv->cell_sort_func_target);
+
+  priv->cell_sort_func = f;
+  priv->cell_sort_func_target = f_target;
+  priv->cell_sort_func_target_destroy_notify = f_target_destroy_notify;
+
+  /* Only the cells are sorted again, widget rows keep their order */
+  cells = g_sequence_new (NULL);
+  for (iter = g_sequence_get_begin_iter (priv->children);
+       !g_sequence_iter_is_end (iter);
+       iter = next)
+    {
+      next = g_sequence_iter_next (iter);
+      if (((PListBoxChildInfo *) g_sequence_get (iter))->widget == NULL)
+	g_sequence_move (iter, g_sequence_get_end_iter (cells));
+    }
+  g_sequence_sort (cells, (GCompareDataFunc)do_sort, list_box);
+  g_sequence_move_range (g_sequence_get_end_iter (priv->children),
+			 g_sequence_get_begin_iter (cells),
+			 g_sequence_get_end_iter (cells));
+  g_sequence_free (cells);
+
+  priv->rows_dirty = TRUE;
+  p_list_box_accessible_reordered (list_box);
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+}
+
+/**
+ * p_list_box_get_selected_cell:
+ * @self: a #PListBox
+ *
+ * Gets the selected cell. Use this instead of
+ * p_list_box_get_selected_child(), which returns %NULL when the
+ * selection is a cell.
+ *
+ * Return value: (transfer none): The selected cell, or %NULL.
+ **/
+PListBoxCell *
+p_list_box_get_selected_cell (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  g_return_val_if_fail (list_box != NULL, NULL);
+
+  if (priv->selected_child != NULL && priv->selected_child->widget == NULL)
+    return (PListBoxCell *) priv->selected_child;
+
+  return NULL;
+}
+
+/* Finds the section whose header starts at or above y */
+static guint
+p_list_box_bisect_sections (PListBox *list_box, gint y)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  guint lo, hi, mid;
+
+  lo = 0;
+  hi = priv->n_sections;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (priv->section_y[mid] <= y)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo > 0 ? lo - 1 : 0;
+}
+
+static GtkWidget *
+p_list_box_create_header (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GtkWidget *header;
+  gint height;
+
+  header = priv->create_header_func (list_box, g_quark_to_string (info->section),
+				     priv->create_header_func_target);
+  if (header == NULL)
+    return NULL;
+
+  g_object_ref_sink (header);
+  g_object_set_qdata (G_OBJECT (header), header_quark, info);
+  g_hash_table_insert (priv->headers, info, header);
+  gtk_widget_set_child_visible (header, FALSE);
+  gtk_widget_set_parent (header, GTK_WIDGET (list_box));
+  gtk_widget_show (header);
+
+  /* So that the sections can be placed before the next allocation
+     measures the headers for its width */
+  gtk_widget_get_preferred_height (header, &height, NULL);
+  priv->header_height = MAX (priv->header_height, height);
+
+  return header;
+}
+
+/* Gives the row at iter a header if it starts a section and takes it
+   away otherwise. Called along with p_list_box_update_separator(). */
+static void
+p_list_box_update_header (PListBox *list_box, GSequenceIter *iter)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info, *before_info;
+  GSequenceIter *before_iter;
+  gboolean starts;
+
+  if (iter == NULL || g_sequence_iter_is_end (iter))
+    return;
+
+  info = g_sequence_get (iter);
+  starts = FALSE;
+  if (priv->create_header_func != NULL &&
+      priv->layout_mode == P_LIST_BOX_LAYOUT_LIST &&
+      info->section != 0 && child_info_is_visible (info))
+    {
+      before_iter = p_list_box_get_previous_visible (list_box, iter);
+      before_info = NULL;
+      if (before_iter != NULL)
+	before_info = g_sequence_get (before_iter);
+      starts = before_info == NULL || before_info->section != info->section;
+    }
+
+  if (starts == (g_hash_table_lookup (priv->headers, info) != NULL))
+    return;
+
+  if (starts)
+    p_list_box_create_header (list_box, info);
+  else
+    p_list_box_drop_header (list_box, info);
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+}
+
+/* Gets rid of the header of the section starting at info, if any */
+static void
+p_list_box_drop_header (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GtkWidget *header;
+
+  header = g_hash_table_lookup (priv->headers, info);
+  if (header == NULL)
+    return;
+
+  if (info == priv->pinned_section)
+    priv->pinned_section = NULL;
+  g_object_set_qdata (G_OBJECT (header), header_quark, NULL);
+  gtk_widget_unparent (header);
+  g_hash_table_remove (priv->headers, info);
+}
+
+static void
+p_list_box_drop_all_headers (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GList *sections, *l;
+
+  sections = g_hash_table_get_keys (priv->headers);
+  for (l = sections; l != NULL; l = l->next)
+    p_list_box_drop_header (list_box, l->data);
+  g_list_free (sections);
+}
+
+/* All headers are laid out at one height, the tallest one at width */
+static gint
+p_list_box_get_header_height (PListBox *list_box, gint width)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GHashTableIter iter;
+  GtkWidget *header;
+  gint height, header_min;
+
+  if (g_hash_table_size (priv->headers) == 0)
+    return MAX (priv->header_height, 0);
+
+  height = 0;
+  g_hash_table_iter_init (&iter, priv->headers);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &header))
+    {
+      gtk_widget_get_preferred_height_for_width (header, width, &header_min, NULL);
+      height = MAX (height, header_min);
+    }
+  priv->header_height = height;
+
+  return height;
+}
+
+/* Allocates the headers of the sections within a page of the view,
+   hides the others, and pins the header of the section at the top of
+   the view. Run on every allocation and scroll step, headers are made
+   elsewhere. */
+static void
+p_list_box_update_headers (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info;
+  GtkAllocation allocation;
+  GtkAllocation header_allocation;
+  GHashTableIter iter;
+  GtkWidget *header;
+  gboolean has_view;
+  gint view_start, view_end, margin;
+  guint first, last, active, s;
+
+  if (priv->create_header_func == NULL)
+    return;
+  p_list_box_ensure_rows (list_box);
+  if (priv->n_sections == 0)
+    return;
+
+  gtk_widget_get_allocation (GTK_WIDGET (list_box), &allocation);
+  has_view = p_list_box_get_view_range (list_box, &allocation, &view_start, &view_end);
+  if (has_view)
+    {
+      margin = view_end - view_start;
+      first = p_list_box_bisect_sections (list_box, view_start - margin);
+      last = p_list_box_bisect_sections (list_box, view_end + margin);
+      active = p_list_box_bisect_sections (list_box, view_start);
+    }
+  else
+    {
+      first = 0;
+      last = priv->n_sections - 1;
+      active = G_MAXUINT;
+    }
+
+  g_hash_table_iter_init (&iter, priv->headers);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &info, (gpointer *) &header))
+    {
+      s = p_list_box_bisect_sections (list_box, row_get_y (list_box, info));
+      gtk_widget_set_child_visible (header, s >= first && s <= last &&
+				    priv->section_info[s] == info);
+    }
+
+  priv->pinned_section = NULL;
+  priv->header_first = first;
+  priv->header_last = last;
+  header_allocation.x = 0;
+  header_allocation.width = allocation.width;
+  header_allocation.height = priv->header_height;
+  for (s = first; s <= last; s++)
+    {
+      info = priv->section_info[s];
+      if (info->section == 0)
+	continue;
+
+      header = g_hash_table_lookup (priv->headers, info);
+      if (header == NULL)
+	continue;
+
+      header_allocation.y = priv->section_y[s];
+      if (s == active)
+	{
+	  /* Stays at the top of the view until the next header pushes
+	     it out */
+	  header_allocation.y = MAX (header_allocation.y, view_start);
+	  if (s + 1 < priv->n_sections)
+	    header_allocation.y = MIN (header_allocation.y,
+				       priv->section_y[s + 1] - priv->header_height);
+	  priv->pinned_section = info;
+	  priv->pinned_y = header_allocation.y;
+	}
+      gtk_widget_size_allocate (header, &header_allocation);
+    }
+}
+
+/**
+ * p_list_box_set_header_func:
+ * @self: a #PListBox
+ * @create_header: (allow-none): creates the header for a section
+ * @create_header_target: (allow-none): user data for @create_header
+ * @create_header_target_destroy_notify: (allow-none): destroys @create_header_target
+ *
+ * Turns the list into a list of sections. Consecutive visible rows
+ * with the same section name, see p_list_box_set_child_section(), form
+ * a section, and each named section starts with a header created by
+ * @create_header. The header of the section at the top of the view
+ * stays pinned there while its rows scroll by.
+ *
+ * Headers are created as sections come up and destroyed when they go
+ * away, so @create_header may be called for the same section several
+ * times. Only the headers near the view are laid out and drawn. All
+ * headers are given the same height. Pass %NULL to go back to a plain
+ * list.
+ */
+void
+p_list_box_set_header_func (PListBox *list_box,
+			     PListBoxCreateHeaderFunc create_header,
+			     void *create_header_target,
+			     GDestroyNotify create_header_target_destroy_notify)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  g_return_if_fail (list_box != NULL);
+
+  p_list_box_drop_all_headers (list_box);
+  if (priv->create_header_func_target_destroy_notify != NULL)
+    priv->create_header_func_target_destroy_notify (priv->create_header_func_target);
+
+  priv->create_header_func = create_header;
+  priv->create_header_func_target = create_header_target;
+  priv->create_header_func_target_destroy_notify = create_header_target_destroy_notify;
+  priv->n_sections = 0;
+  priv->header_height = -1;
+  p_list_box_reseparate (list_box);
+}
+
+static void
+p_list_box_set_section (PListBox *list_box,
+			 PListBoxChildInfo *info,
+			 const gchar *section)
+{
+  GQuark quark;
+
+  quark = section != NULL ? g_quark_from_string (section) : 0;
+  if (info->section == quark)
+    return;
+
+  info->section = quark;
+  if (list_box->priv->create_header_func == NULL ||
+      g_sequence_iter_get_sequence (info->iter) != list_box->priv->children)
+    return;
+
+  /* The row after it may start or stop starting a section too */
+  p_list_box_update_header (list_box, info->iter);
+  p_list_box_update_header (list_box, p_list_box_get_next_visible (list_box, info->iter));
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+}
+
+/**
+ * p_list_box_set_child_section:
+ * @self: a #PListBox
+ * @child: a child of @self
+ * @section: (allow-none): the name of the section of @child, or %NULL
+ *
+ * Puts @child in a section, see p_list_box_set_header_func(). Rows of
+ * a section should be kept together, typically by the sort function.
+ * Rows without a section get no header.
+ */
+void
+p_list_box_set_child_section (PListBox *list_box,
+			       GtkWidget *child,
+			       const gchar *section)
+{
+  PListBoxChildInfo *info;
+
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (child != NULL);
+
+  info = p_list_box_lookup_info (list_box, child);
+  if (info == NULL)
+    return;
+
+  p_list_box_set_section (list_box, info, section);
+}
+
+/**
+ * p_list_box_cell_set_section:
+ * @self: a #PListBox
+ * @cell: a cell of @self
+ * @section: (allow-none): the name of the section of @cell, or %NULL
+ *
+ * Puts @cell in a section, like p_list_box_set_child_section().
+ */
+void
+p_list_box_cell_set_section (PListBox *list_box,
+			      PListBoxCell *cell,
+			      const gchar *section)
+{
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (cell != NULL);
+
+  p_list_box_set_section (list_box, (PListBoxChildInfo *) cell, section);
+}
+
+static void
+p_list_box_search_entry_free (PListBoxSearchEntry *entry)
+{
+  g_free (entry->key);
+  g_slice_free (PListBoxSearchEntry, entry);
+}
+
+static gint
+p_list_box_search_entry_compare (PListBoxSearchEntry *a,
+				  PListBoxSearchEntry *b,
+				  gpointer user_data)
+{
+  return strcmp (a->key, b->key);
+}
+
+/* Search keys and typed text are compared in this form, so that case
+   and the way characters are composed do not matter */
+static gchar *
+p_list_box_fold_key (const gchar *key, gssize len)
+{
+  gchar *normalized, *folded;
+
+  normalized = g_utf8_normalize (key, len, G_NORMALIZE_ALL);
+  if (normalized == NULL)
+    return NULL;
+
+  folded = g_utf8_casefold (normalized, -1);
+  g_free (normalized);
+  return folded;
+}
+
+/* Widget rows get their key from the search key function, cells are
+   searched by the text of the describe cell function */
+static gchar *
+p_list_box_get_search_key (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  if (info->widget != NULL)
+    {
+      if (priv->search_key_func == NULL)
+	return NULL;
+      return priv->search_key_func (info->widget, priv->search_key_func_target);
+    }
+
+  if (priv->cell_funcs.describe == NULL)
+    return NULL;
+  return priv->cell_funcs.describe (list_box, info->cell_data, priv->cell_funcs_target);
+}
+
+static void
+p_list_box_unindex_row (PListBox *list_box, PListBoxChildInfo *info)
+{
+  if (info->search_iter == NULL)
+    return;
+
+  g_sequence_remove (info->search_iter);
+  info->search_iter = NULL;
+}
+
+/* Puts the row in the search index under its current key */
+static void
+p_list_box_index_row (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxSearchEntry *entry;
+  gchar *key, *folded;
+
+  p_list_box_unindex_row (list_box, info);
+  if (!priv->search_indexed)
+    return;
+
+  key = p_list_box_get_search_key (list_box, info);
+  if (key == NULL)
+    return;
+  folded = p_list_box_fold_key (key, -1);
+  g_free (key);
+  if (folded == NULL)
+    return;
+
+  entry = g_slice_new (PListBoxSearchEntry);
+  entry->key = folded;
+  entry->info = info;
+  info->search_iter = g_sequence_insert_sorted (priv->search_index, entry,
+						(GCompareDataFunc) p_list_box_search_entry_compare,
+						NULL);
+}
+
+/* Drops the index, the next keystroke builds it again with the
+   current keys */
+static void
+p_list_box_reindex (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  if (!priv->search_indexed)
+    return;
+
+  priv->search_indexed = FALSE;
+  p_list_box_foreach_row (list_box, priv->children, p_list_box_unindex_row);
+}
+
+/* Asks every row for its key, only done once text is typed */
+static void
+p_list_box_ensure_search_index (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  if (priv->search_indexed)
+    return;
+
+  priv->search_indexed = TRUE;
+  p_list_box_foreach_row (list_box, priv->children, p_list_box_index_row);
+}
+
+/* Finds the row to jump to for the typed text: of the visible rows
+   whose key starts with it, the first one at or below the cursor, or
+   failing that the first one in the list. Only the matching entries
+   of the index are looked at. */
+static PListBoxChildInfo *
+p_list_box_search (PListBox *list_box, const gchar *text)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxSearchEntry probe, *entry;
+  PListBoxChildInfo *below, *first;
+  GSequenceIter *iter, *prev;
+  gsize len;
+  guint start;
+
+  probe.key = p_list_box_fold_key (text, -1);
+  if (probe.key == NULL)
+    return NULL;
+  p_list_box_ensure_search_index (list_box);
+  len = strlen (probe.key);
+
+  /* Lands after the keys equal to the text, which match too */
+  iter = g_sequence_search (priv->search_index, &probe,
+			    (GCompareDataFunc) p_list_box_search_entry_compare, NULL);
+  while (!g_sequence_iter_is_begin (iter))
+    {
+      prev = g_sequence_iter_prev (iter);
+      entry = g_sequence_get (prev);
+      if (strcmp (entry->key, probe.key) != 0)
+	break;
+      iter = prev;
+    }
+
+  p_list_box_ensure_rows (list_box);
+  start = priv->cursor_child != NULL ? priv->cursor_child->index : 0;
+  below = NULL;
+  first = NULL;
+
+  for (; !g_sequence_iter_is_end (iter); iter = g_sequence_iter_next (iter))
+    {
+      entry = g_sequence_get (iter);
+      if (strncmp (entry->key, probe.key, len) != 0)
+	break;
+      if (!child_info_is_visible (entry->info))
+	continue;
+
+      if (entry->info->index >= start &&
+	  (below == NULL || entry->info->index < below->index))
+	below = entry->info;
+      if (first == NULL || entry->info->index < first->index)
+	first = entry->info;
+    }
+
+  g_free (probe.key);
+  return below != NULL ? below : first;
+}
+
+static gboolean
+p_list_box_search_timeout (gpointer user_data)
+{
+  PListBox *list_box = user_data;
+  PListBoxPrivate *priv = list_box->priv;
+
+  g_string_truncate (priv->search_text, 0);
+  priv->search_timeout_id = 0;
+  return FALSE;
+}
+
+static void
+p_list_box_search_jump (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *child;
+
+  if (priv->search_timeout_id != 0)
+    g_source_remove (priv->search_timeout_id);
+  priv->search_timeout_id = g_timeout_add (SEARCH_TIMEOUT, p_list_box_search_timeout, list_box);
+
+  if (priv->search_text->len == 0)
+    return;
+
+  child = p_list_box_search (list_box, priv->search_text->str);
+  if (child == NULL)
+    {
+      gtk_widget_error_bell (GTK_WIDGET (list_box));
+      return;
+    }
+
+  p_list_box_update_cursor (list_box, child);
+  p_list_box_update_selected (list_box, child);
+}
+
+static gboolean
+p_list_box_real_key_press_event (GtkWidget *widget,
+				  GdkEventKey *event)
+{
+  PListBox *list_box = P_LIST_BOX (widget);
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *cursor = priv->cursor_child;
+  gboolean expand;
+  gunichar c;
+
+  /* Right expands the cursor row, Left collapses it or goes up to its
+     parent; modified arrows are left to the move bindings */
+  if (priv->has_tree && cursor != NULL && cursor->widget != NULL &&
+      (event->state & gtk_accelerator_get_default_mod_mask ()) == 0 &&
+      (event->keyval == GDK_KEY_Left || event->keyval == GDK_KEY_KP_Left ||
+       event->keyval == GDK_KEY_Right || event->keyval == GDK_KEY_KP_Right))
+    {
+      expand = event->keyval == GDK_KEY_Right || event->keyval == GDK_KEY_KP_Right;
+      if (expand && !cursor->expanded)
+	p_list_box_expand_row (list_box, cursor);
+      else if (!expand && cursor->expanded)
+	p_list_box_collapse_row (list_box, cursor);
+      else if (!expand && cursor->parent_row != NULL)
+	p_list_box_update_selected (list_box, cursor->parent_row);
+      else
+	return GTK_WIDGET_CLASS (p_list_box_parent_class)->key_press_event (widget, event);
+      return TRUE;
+    }
+
+  if (priv->search_key_func == NULL && priv->cell_funcs.describe == NULL)
+    return GTK_WIDGET_CLASS (p_list_box_parent_class)->key_press_event (widget, event);
+
+  if (priv->search_text->len > 0)
+    {
+      if (event->keyval == GDK_KEY_BackSpace)
+	{
+	  g_string_truncate (priv->search_text,
+			     g_utf8_prev_char (priv->search_text->str + priv->search_text->len) -
+			     priv->search_text->str);
+	  p_list_box_search_jump (list_box);
+	  return TRUE;
+	}
+      if (event->keyval == GDK_KEY_Escape)
+	{
+	  g_source_remove (priv->search_timeout_id);
+	  p_list_box_search_timeout (list_box);
+	  return TRUE;
+	}
+    }
+
+  /* Space only continues a search, it toggles the cursor row otherwise */
+  c = gdk_keyval_to_unicode (event->keyval);
+  if ((event->state & (GDK_CONTROL_MASK | GDK_MOD1_MASK)) == 0 &&
+      c != 0 && g_unichar_isprint (c) &&
+      (priv->search_text->len > 0 || !g_unichar_isspace (c)))
+    {
+      p_list_box_ensure_search_index (list_box);
+      if (g_sequence_get_length (priv->search_index) == 0)
+	return GTK_WIDGET_CLASS (p_list_box_parent_class)->key_press_event (widget, event);
+      g_string_append_unichar (priv->search_text, c);
+      p_list_box_search_jump (list_box);
+      return TRUE;
+    }
+
+  return GTK_WIDGET_CLASS (p_list_box_parent_class)->key_press_event (widget, event);
+}
+
+/**
+ * p_list_box_set_search_key_func:
+ * @self: a #PListBox
+ * @f: (allow-none): returns the text a row is found by, or %NULL
+ * @f_target: (allow-none): user data for @f
+ * @f_target_destroy_notify: (allow-none): destroys @f_target
+ *
+ * Enables type-ahead. While the list has the focus, typed text moves
+ * the cursor to the first visible row, in list order from the cursor
+ * on, whose key starts with it, ignoring case. The text is forgotten
+ * after a second without typing.
+ *
+ * @f returns a newly allocated key for a widget row. The keys are kept
+ * in a sorted index, so typing does not go through the rows. The index
+ * is built when text is first typed, from then on @f is asked when a
+ * row is added and on p_list_box_child_changed(). Cells are found by
+ * the text of their describe function.
+ */
+void
+p_list_box_set_search_key_func (PListBox *list_box,
+				 PListBoxSearchKeyFunc f,
+				 void *f_target,
+				 GDestroyNotify f_target_destroy_notify)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  g_return_if_fail (list_box != NULL);
+
+  if (priv->search_key_func_target_destroy_notify != NULL)
+    priv->search_key_func_target_destroy_notify (priv->search_key_func_target);
+
+  priv->search_key_func = f;
+  priv->search_key_func_target = f_target;
+  priv->search_key_func_target_destroy_notify = f_target_destroy_notify;
+  p_list_box_reindex (list_box);
+}
+
+static void
+p_list_box_free_columns (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  guint i;
+
+  for (i = 0; i < priv->n_columns; i++)
+    g_hash_table_unref (priv->column_counts[i]);
+  g_free (priv->column_counts);
+  g_free (priv->column_max);
+  priv->column_counts = NULL;
+  priv->column_max = NULL;
+  priv->n_columns = 0;
+}
+
+/* Adds (count 1) or takes back (count -1) one row's width for a
+   column. Returns TRUE if the maximum of the column changed. */
+static gboolean
+p_list_box_count_column_width (PListBox *list_box,
+				guint column,
+				gint width,
+				gint count)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GHashTable *counts = priv->column_counts[column];
+  GHashTableIter iter;
+  gpointer key;
+  gint n, max;
+
+  n = GPOINTER_TO_INT (g_hash_table_lookup (counts, GINT_TO_POINTER (width))) + count;
+  if (n > 0)
+    g_hash_table_insert (counts, GINT_TO_POINTER (width), GINT_TO_POINTER (n));
+  else
+    g_hash_table_remove (counts, GINT_TO_POINTER (width));
+
+  if (count > 0)
+    {
+      if (width <= priv->column_max[column])
+	return FALSE;
+      priv->column_max[column] = width;
+      return TRUE;
+    }
+
+  if (width < priv->column_max[column] || n > 0)
+    return FALSE;
+
+  /* The widest row went away, the next widest is among the distinct
+     widths left, which are usually few */
+  max = 0;
+  g_hash_table_iter_init (&iter, counts);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    max = MAX (max, GPOINTER_TO_INT (key));
+  priv->column_max[column] = max;
+  return TRUE;
+}
+
+/* Tiles in flight are dropped when they come back, by the serial */
+static void
+p_list_box_columns_changed (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *tiled;
+
+  priv->columns_serial++;
+  while ((tiled = g_queue_peek_head (priv->tiles)) != NULL)
+    p_list_box_invalidate_tile (list_box, tiled);
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+}
+
+static void
+p_list_box_forget_row_columns (PListBox *list_box, PListBoxChildInfo *info)
+{
+  g_free (info->column_widths);
+  info->column_widths = NULL;
+}
+
+/* Replaces the column widths of a row, NULL takes them back */
+static void
+p_list_box_set_row_columns (PListBox *list_box,
+			     PListBoxChildInfo *info,
+			     const gint *widths)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  gboolean changed;
+  guint i;
+
+  if (info->column_widths == NULL && widths == NULL)
+    return;
+
+  changed = FALSE;
+  for (i = 0; i < priv->n_columns; i++)
+    {
+      if (info->column_widths != NULL && widths != NULL &&
+	  info->column_widths[i] == widths[i])
+	continue;
+      if (info->column_widths != NULL &&
+	  p_list_box_count_column_width (list_box, i, info->column_widths[i], -1))
+	changed = TRUE;
+      if (widths != NULL &&
+	  p_list_box_count_column_width (list_box, i, MAX (widths[i], 0), 1))
+	changed = TRUE;
+    }
+
+  if (widths == NULL)
+    {
+      g_free (info->column_widths);
+      info->column_widths = NULL;
+    }
+  else
+    {
+      if (info->column_widths == NULL)
+	info->column_widths = g_new (gint, priv->n_columns);
+      for (i = 0; i < priv->n_columns; i++)
+	info->column_widths[i] = MAX (widths[i], 0);
+    }
+
+  if (info->widget == NULL)
+    p_list_box_invalidate_tile (list_box, info);
+  if (!changed)
+    return;
+
+  /* Every row has to line up with the new widths, that happens on the
+     next allocation. Cells pick them up when drawn. */
+  p_list_box_columns_changed (list_box);
+}
+
+/**
+ * p_list_box_set_columns:
+ * @self: a #PListBox
+ * @n_columns: the number of columns, or 0
+ * @update_columns: (allow-none): lays out a row for the column widths
+ * @update_columns_target: (allow-none): user data for @update_columns
+ * @update_columns_target_destroy_notify: (allow-none): destroys @update_columns_target
+ *
+ * Declares @n_columns columns to line up across the rows. Rows tell
+ * the width they need in each column with
+ * p_list_box_set_child_column_widths(), and every column gets as wide
+ * as the widest row needs. This replaces putting the parts of every
+ * row in #GtkSizeGroups, which measure every row of the group on each
+ * size request, as the list keeps the column widths up to date as
+ * rows report, change or go away.
+ *
+ * Widget rows are handed the column widths through @update_columns
+ * during allocation, before they are measured, but only if the widths
+ * changed since the row last saw them. Cells can read them with
+ * p_list_box_get_column_width() when drawn.
+ *
+ * Reported widths are forgotten when the number of columns changes.
+ */
+void
+p_list_box_set_columns (PListBox *list_box,
+			 guint n_columns,
+			 PListBoxUpdateColumnsFunc update_columns,
+			 void *update_columns_target,
+			 GDestroyNotify update_columns_target_destroy_notify)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  guint i;
+
+  g_return_if_fail (list_box != NULL);
+
+  if (priv->update_columns_func_target_destroy_notify != NULL)
+    priv->update_columns_func_target_destroy_notify (priv->update_columns_func_target);
+  priv->update_columns_func = update_columns;
+  priv->update_columns_func_target = update_columns_target;
+  priv->update_columns_func_target_destroy_notify = update_columns_target_destroy_notify;
+
+  if (n_columns != priv->n_columns)
+    {
+      p_list_box_foreach_row (list_box, priv->children, p_list_box_forget_row_columns);
+      p_list_box_free_columns (list_box);
+      priv->n_columns = n_columns;
+      priv->column_max = g_new0 (gint, n_columns);
+      priv->column_counts = g_new (GHashTable *, n_columns);
+      for (i = 0; i < n_columns; i++)
+	priv->column_counts[i] = g_hash_table_new (g_direct_hash, g_direct_equal);
+    }
+
+  p_list_box_columns_changed (list_box);
+}
+
+/**
+ * p_list_box_set_child_column_widths:
+ * @self: a #PListBox
+ * @child: a child of @self
+ * @widths: (array) (allow-none): the width @child needs in each column,
+ *   or %NULL
+ *
+ * Tells @self how wide each column has to be for @child, see
+ * p_list_box_set_columns(). @widths holds one width per column and is
+ * copied. Only the changes to the column widths are worked out, so
+ * call this again whenever the content of @child changes. %NULL
+ * leaves @child out of the column widths.
+ */
+void
+p_list_box_set_child_column_widths (PListBox *list_box,
+				     GtkWidget *child,
+				     const gint *widths)
+{
+  PListBoxChildInfo *info;
+
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (child != NULL);
+
+  info = p_list_box_lookup_info (list_box, child);
+  if (info == NULL)
+    return;
+
+  p_list_box_set_row_columns (list_box, info, widths);
+}
+
+/**
+ * p_list_box_cell_set_column_widths:
+ * @self: a #PListBox
+ * @cell: a cell of @self
+ * @widths: (array) (allow-none): the width @cell needs in each column,
+ *   or %NULL
+ *
+ * Like p_list_box_set_child_column_widths(), for a cell.
+ */
+void
+p_list_box_cell_set_column_widths (PListBox *list_box,
+				    PListBoxCell *cell,
+				    const gint *widths)
+{
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (cell != NULL);
+
+  p_list_box_set_row_columns (list_box, (PListBoxChildInfo *) cell, widths);
+}
+
+/**
+ * p_list_box_get_column_width:
+ * @self: a #PListBox
+ * @column: a column index
+ *
+ * Gets the width of a column, the largest width reported for it by
+ * any row.
+ *
+ * Called from a render function, this gives the width the column had
+ * when the render was requested, which is safe to read on the worker
+ * thread.
+ *
+ * Return value: the width of @column
+ */
+gint
+p_list_box_get_column_width (PListBox *list_box,
+			      guint column)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxRenderJob *job;
+
+  g_return_val_if_fail (list_box != NULL, 0);
+
+  job = g_private_get (&render_job_key);
+  if (job != NULL && job->list_box == list_box)
+    {
+      g_return_val_if_fail (column < job->n_columns, 0);
+      return job->column_widths[column];
+    }
+
+  g_return_val_if_fail (column < priv->n_columns, 0);
+
+  return priv->column_max[column];
+}
+
+/* The iter after the last descendant of info in its sequence */
+static GSequenceIter *
+p_list_box_get_subtree_end (PListBoxChildInfo *info)
+{
+  GSequenceIter *iter;
+
+  iter = g_sequence_iter_next (info->iter);
+  while (!g_sequence_iter_is_end (iter) &&
+	 ((PListBoxChildInfo *) g_sequence_get (iter))->depth > info->depth)
+    iter = g_sequence_iter_next (iter);
+
+  return iter;
+}
+
+static void
+p_list_box_remove_descendants (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxChildInfo *last;
+  GSequenceIter *end;
+
+  /* From the last one up, so no removed row leaves descendants behind */
+  if (info->collapsed != NULL)
+    while (g_sequence_get_length (info->collapsed) > 0)
+      {
+	last = g_sequence_get (g_sequence_iter_prev (g_sequence_get_end_iter (info->collapsed)));
+	gtk_container_remove (GTK_CONTAINER (list_box), last->widget);
+      }
+
+  end = p_list_box_get_subtree_end (info);
+  while ((last = g_sequence_get (g_sequence_iter_prev (end))) != info)
+    gtk_container_remove (GTK_CONTAINER (list_box), last->widget);
+}
+
+/* Called before a row goes away, so its parent does not keep pointing
+   at it. Walks back over the subtree of the previous sibling. */
+static void
+p_list_box_unlink_tree_row (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxChildInfo *parent = info->parent_row;
+  PListBoxChildInfo *prev;
+  GSequenceIter *iter;
+
+  if (parent == NULL || parent->last_child != info)
+    return;
+
+  parent->last_child = NULL;
+  iter = info->iter;
+  while (!g_sequence_iter_is_begin (iter))
+    {
+      iter = g_sequence_iter_prev (iter);
+      prev = g_sequence_get (iter);
+      if (prev->depth <= info->depth)
+	{
+	  if (prev->parent_row == parent)
+	    parent->last_child = prev;
+	  break;
+	}
+    }
+}
+
+/* Shows or hides the rows moved in or out of the list by expanding or
+   collapsing, along with their separators */
+static void
+p_list_box_set_row_shown (PListBoxChildInfo *info, gboolean shown)
+{
+  gtk_widget_set_child_visible (info->widget, shown);
+  if (info->separator != NULL)
+    gtk_widget_set_child_visible (info->separator, shown);
+}
+
+static void
+p_list_box_collapse_row (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *row;
+  GSequenceIter *first, *end;
+  gboolean in_view;
+  gint position, count;
+
+  if (!info->expanded)
+    return;
+  info->expanded = FALSE;
+
+  in_view = g_sequence_iter_get_sequence (info->iter) == priv->children;
+  first = g_sequence_iter_next (info->iter);
+  count = 0;
+  for (end = first;
+       !g_sequence_iter_is_end (end) &&
+	 (row = g_sequence_get (end))->depth > info->depth;
+       end = g_sequence_iter_next (end))
+    {
+      count++;
+      if (!in_view)
+	continue;
+
+      if (row == priv->selected_child)
+	p_list_box_update_selected (list_box, NULL);
+      if (row == priv->cursor_child)
+	priv->cursor_child = info;
+      if (row == priv->prelight_child)
+	priv->prelight_child = NULL;
+      if (row == priv->active_child)
+	priv->active_child = NULL;
+      p_list_box_drop_header (list_box, row);
+      p_list_box_set_row_shown (row, FALSE);
+    }
+
+  if (count == 0)
+    return;
+
+  position = g_sequence_iter_get_position (first);
+  if (info->collapsed == NULL)
+    info->collapsed = g_sequence_new ((GDestroyNotify)p_list_box_child_info_free);
+  g_sequence_move_range (g_sequence_get_end_iter (info->collapsed), first, end);
+  if (!in_view)
+    return;
+
+  priv->rows_dirty = TRUE;
+  while (count-- > 0)
+    p_list_box_accessible_row_changed (list_box, position + count, FALSE);
+  if (gtk_widget_get_visible (GTK_WIDGET (list_box)))
+    p_list_box_update_separator (list_box, p_list_box_get_next_visible (list_box, info->iter));
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+}
+
+/* Puts the descendants of an expanded row back after it */
+static void
+p_list_box_restore_collapsed (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *row;
+  GSequenceIter *first, *end, *iter;
+  gint position, count, i;
+
+  if (info->collapsed == NULL || g_sequence_get_length (info->collapsed) == 0)
+    return;
+
+  /* The sort order may have changed while they were away */
+  if (priv->sort_func != NULL)
+    g_sequence_sort (info->collapsed, (GCompareDataFunc)do_sort, list_box);
+  count = g_sequence_get_length (info->collapsed);
+  end = g_sequence_iter_next (info->iter);
+  g_sequence_move_range (end,
+			 g_sequence_get_begin_iter (info->collapsed),
+			 g_sequence_get_end_iter (info->collapsed));
+  if (g_sequence_iter_get_sequence (info->iter) != priv->children)
+    return;
+
+  first = g_sequence_iter_next (info->iter);
+  position = g_sequence_iter_get_position (first);
+  for (iter = first, i = 0; i < count; iter = g_sequence_iter_next (iter), i++)
+    {
+      row = g_sequence_get (iter);
+      p_list_box_set_row_shown (row, TRUE);
+      p_list_box_apply_filter (list_box, row->widget);
+      p_list_box_update_header (list_box, iter);
+      p_list_box_accessible_row_changed (list_box, position + i, TRUE);
+    }
+
+  priv->rows_dirty = TRUE;
+  if (gtk_widget_get_visible (GTK_WIDGET (list_box)))
+    {
+      p_list_box_update_separator (list_box, first);
+      p_list_box_update_separator (list_box, p_list_box_get_next_visible (list_box, g_sequence_iter_prev (end)));
+    }
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+}
+
+static void
+p_list_box_expand_row (PListBox *list_box, PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  if (info->expanded)
+    return;
+  info->expanded = TRUE;
+
+  /* Also rows added with p_list_box_add_child_row() before the first
+     expand, ahead of the loaded ones */
+  p_list_box_restore_collapsed (list_box, info);
+
+  /* Children added from here go straight into place */
+  if (!info->children_loaded)
+    {
+      info->children_loaded = TRUE;
+      if (priv->load_children_func != NULL)
+	priv->load_children_func (list_box, info->widget, priv->load_children_func_target);
+    }
+}
+
+static void
+p_list_box_forall_sequence (GSequence *sequence,
+			     gboolean include_internals,
+			     GPtrArray *widgets)
+{
+  PListBoxChildInfo *child_info;
+  GSequenceIter *iter;
+
+  for (iter = g_sequence_get_begin_iter (sequence);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      child_info = g_sequence_get (iter);
+      if (child_info->separator != NULL && include_internals)
+	g_ptr_array_add (widgets, g_object_ref (child_info->separator));
+      if (child_info->widget != NULL)
+	g_ptr_array_add (widgets, g_object_ref (child_info->widget));
+      if (child_info->collapsed != NULL)
+	p_list_box_forall_sequence (child_info->collapsed, include_internals, widgets);
+    }
+}
+
+/* Collapsed rows are children too. Removing a row removes the rows
+   after it in a tree, so this goes over a copy. */
+static void
+p_list_box_forall_tree (PListBox *list_box,
+			 gboolean include_internals,
+			 GtkCallback callback,
+			 void *callback_target)
+{
+  GPtrArray *widgets;
+  GtkWidget *widget;
+  guint i;
+
+  widgets = g_ptr_array_new_with_free_func (g_object_unref);
+  p_list_box_forall_sequence (list_box->priv->children, include_internals, widgets);
+  for (i = 0; i < widgets->len; i++)
+    {
+      widget = g_ptr_array_index (widgets, i);
+      if (gtk_widget_get_parent (widget) == GTK_WIDGET (list_box))
+	callback (widget, callback_target);
+    }
+  g_ptr_array_free (widgets, TRUE);
+}
+
+/**
+ * p_list_box_set_load_children_func:
+ * @self: a #PListBox
+ * @f: (allow-none): adds the children of a row
+ * @f_target: (allow-none): user data for @f
+ * @f_target_destroy_notify: (allow-none): destroys @f_target
+ *
+ * Sets the function that adds the children of a row, with
+ * p_list_box_add_child_row(), the first time the row is expanded.
+ */
+void
+p_list_box_set_load_children_func (PListBox *list_box,
+				    PListBoxLoadChildrenFunc f,
+				    void *f_target,
+				    GDestroyNotify f_target_destroy_notify)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  g_return_if_fail (list_box != NULL);
+
+  if (priv->load_children_func_target_destroy_notify != NULL)
+    priv->load_children_func_target_destroy_notify (priv->load_children_func_target);
+
+  priv->load_children_func = f;
+  priv->load_children_func_target = f_target;
+  priv->load_children_func_target_destroy_notify = f_target_destroy_notify;
+  priv->has_tree = TRUE;
+}
+
+/**
+ * p_list_box_add_child_row:
+ * @self: a #PListBox
+ * @parent: a child of @self
+ * @child: the #GtkWidget to add below @parent
+ *
+ * Adds @child as a child row of @parent. It goes after the other
+ * children of @parent, or where the sort function puts it among them,
+ * and is only shown while @parent and all its ancestors are expanded.
+ *
+ * Collapsing a row moves the range of its descendants out of the list
+ * in one piece, and expanding puts the range back, so only those rows
+ * are touched. Removing a row removes its descendants.
+ */
+void
+p_list_box_add_child_row (PListBox *list_box,
+			   GtkWidget *parent,
+			   GtkWidget *child)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *parent_info, *info, *node;
+  GSequence *sequence;
+  GSequenceIter *iter;
+
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (parent != NULL);
+  g_return_if_fail (child != NULL);
+
+  parent_info = p_list_box_lookup_info (list_box, parent);
+  if (parent_info == NULL)
+    return;
+
+  priv->has_tree = TRUE;
+  info = p_list_box_child_info_new (child, priv->serial++);
+  info->visible = gtk_widget_get_visible (child);
+  info->has_windows = p_list_box_widget_has_windows (child);
+  info->parent_row = parent_info;
+  info->depth = parent_info->depth + 1;
+  g_object_set_qdata (G_OBJECT (child), child_info_quark, info);
+  g_signal_connect (child, "notify::visible",
+		    G_CALLBACK (p_list_box_child_visibility_changed), list_box);
+
+  if (parent_info->expanded)
+    sequence = g_sequence_iter_get_sequence (parent_info->iter);
+  else
+    {
+      if (parent_info->collapsed == NULL)
+	parent_info->collapsed = g_sequence_new ((GDestroyNotify)p_list_box_child_info_free);
+      sequence = parent_info->collapsed;
+    }
+
+  if (priv->sort_func != NULL)
+    iter = g_sequence_insert_sorted (sequence, info,
+				     (GCompareDataFunc)do_sort, list_box);
+  else if (!parent_info->expanded)
+    iter = g_sequence_append (sequence, info);
+  else
+    {
+      node = parent_info;
+      while (node->expanded && node->last_child != NULL)
+	node = node->last_child;
+      iter = g_sequence_insert_before (g_sequence_iter_next (node->iter), info);
+    }
+  info->iter = iter;
+  parent_info->last_child = info;
+
+  if (sequence != priv->children)
+    {
+      gtk_widget_set_child_visible (child, FALSE);
+      gtk_widget_set_parent (child, GTK_WIDGET (list_box));
+      p_list_box_index_row (list_box, info);
+      return;
+    }
+
+  priv->rows_dirty = TRUE;
+  gtk_widget_set_parent (child, GTK_WIDGET (list_box));
+  p_list_box_apply_filter (list_box, child);
+  p_list_box_index_row (list_box, info);
+  p_list_box_accessible_row_changed (list_box, g_sequence_iter_get_position (iter), TRUE);
+  if (gtk_widget_get_visible (GTK_WIDGET (list_box)))
+    {
+      p_list_box_update_separator (list_box, iter);
+      p_list_box_update_separator (list_box, p_list_box_get_next_visible (list_box, iter));
+    }
+}
+
+/**
+ * p_list_box_expand_child:
+ * @self: a #PListBox
+ * @child: a child of @self
+ *
+ * Shows the children of @child. The first time, they are loaded with
+ * the function set with p_list_box_set_load_children_func().
+ */
+void
+p_list_box_expand_child (PListBox *list_box,
+			  GtkWidget *child)
+{
+  PListBoxChildInfo *info;
+
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (child != NULL);
+
+  info = p_list_box_lookup_info (list_box, child);
+  if (info == NULL)
+    return;
+
+  p_list_box_expand_row (list_box, info);
+}
+
+/**
+ * p_list_box_collapse_child:
+ * @self: a #PListBox
+ * @child: a child of @self
+ *
+ * Hides the descendants of @child. They are kept, and shown again in
+ * the same state when @child is expanded.
+ */
+void
+p_list_box_collapse_child (PListBox *list_box,
+			    GtkWidget *child)
+{
+  PListBoxChildInfo *info;
+
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (child != NULL);
+
+  info = p_list_box_lookup_info (list_box, child);
+  if (info == NULL)
+    return;
+
+  p_list_box_collapse_row (list_box, info);
+}
+
+/**
+ * p_list_box_get_child_expanded:
+ * @self: a #PListBox
+ * @child: a child of @self
+ *
+ * Return value: %TRUE if @child is expanded
+ */
+gboolean
+p_list_box_get_child_expanded (PListBox *list_box,
+				GtkWidget *child)
+{
+  PListBoxChildInfo *info;
+
+  g_return_val_if_fail (list_box != NULL, FALSE);
+  g_return_val_if_fail (child != NULL, FALSE);
+
+  info = p_list_box_lookup_info (list_box, child);
+  return info != NULL && info->expanded;
+}
+
+/**
+ * p_list_box_get_child_depth:
+ * @self: a #PListBox
+ * @child: a child of @self
+ *
+ * Gets how deep @child is in the tree, so rows can indent themselves.
+ * Rows added with gtk_container_add() are at depth 0.
+ *
+ * Return value: the number of ancestors of @child
+ */
+guint
+p_list_box_get_child_depth (PListBox *list_box,
+			     GtkWidget *child)
+{
+  PListBoxChildInfo *info;
+
+  g_return_val_if_fail (list_box != NULL, 0);
+  g_return_val_if_fail (child != NULL, 0);
+
+  info = p_list_box_lookup_info (list_box, child);
+  return info != NULL ? info->depth : 0;
+}
+
+/* Grid layout */
+
+static guint
+p_list_box_get_grid_columns (gint width, gint item_width)
+{
+  if (item_width <= 0)
+    return 1;
+  return MAX (width / item_width, 1);
+}
+
+/* Tiles are as large as set, or else as the first visible row wants
+   to be. Cells can't say how wide they want to be, so without a set
+   width they get a band each. */
+static void
+p_list_box_get_grid_item_size (PListBox *list_box,
+				gint *width,
+				gint *height)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info;
+  gint focus;
+
+  *width = priv->grid_item_width;
+  *height = priv->grid_item_height;
+  if (*width <= 0 || *height <= 0)
+    {
+      info = p_list_box_get_first_visible (list_box);
+      if (info != NULL && info->widget != NULL)
+	{
+	  if (*width <= 0)
+	    gtk_widget_get_preferred_width (info->widget, NULL, width);
+	  if (*height <= 0)
+	    gtk_widget_get_preferred_height_for_width (info->widget, *width, NULL, height);
+	}
+      else if (info != NULL && *height <= 0 && *width > 0)
+	*height = p_list_box_measure_cell (list_box, info, *width);
+    }
+
+  focus = p_list_box_get_focus_size (list_box);
+  *width = *width > 0 ? *width + 2 * focus : 0;
+  *height = MAX (*height, 0) + 2 * focus;
+}
+
+/* Gets the horizontal extent of row i, all of the width in a list and
+   its column in a grid */
+static void
+p_list_box_get_row_span (PListBox *list_box,
+			  guint i,
+			  gint width,
+			  gint *x,
+			  gint *row_width)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  gint col, cols;
+
+  if (priv->layout_mode == P_LIST_BOX_LAYOUT_LIST ||
+      priv->n_grid == 0 || priv->grid_ordinal[i] >= priv->n_grid)
+    {
+      *x = 0;
+      *row_width = width;
+      return;
+    }
+
+  cols = priv->grid_columns;
+  col = priv->grid_ordinal[i] % cols;
+  *x = col * width / cols;
+  *row_width = (col + 1) * width / cols - *x;
+  if (gtk_widget_get_direction (GTK_WIDGET (list_box)) == GTK_TEXT_DIR_RTL)
+    *x = width - *x - *row_width;
+}
+
+/* Gets the tile delta tiles away from info. Going past either end
+   lands in the first or last band if there is one in that direction,
+   so a partial last band can still be reached from above. */
+static PListBoxChildInfo *
+p_list_box_grid_offset (PListBox *list_box,
+			 PListBoxChildInfo *info,
+			 gint delta)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  guint cols = priv->grid_columns;
+  guint ordinal;
+  gint64 target;
+
+  if (priv->rows_dirty || priv->n_grid == 0)
+    return NULL;
+
+  ordinal = priv->grid_ordinal[info->index];
+  if (ordinal >= priv->n_grid)
+    return NULL;
+
+  target = (gint64) ordinal + delta;
+  if (target < 0)
+    target = ordinal / cols > 0 ? (gint64) (ordinal % cols) : -1;
+  else if (target >= priv->n_grid)
+    target = (priv->n_grid - 1) / cols > ordinal / cols ? (gint64) priv->n_grid - 1 : -1;
+  if (target < 0)
+    return NULL;
+
+  return priv->row_info[priv->grid_rows[target]];
+}
+
+/* All tiles have the same size, so a tile's place follows from its
+   ordinal and nothing is measured per row. As in a list, only tiles
+   in view are allocated. */
+static void
+p_list_box_allocate_grid (PListBox *list_box, GtkAllocation *allocation)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *child_info;
+  gboolean has_view;
+  gint view_start, view_end;
+  gint item_width, item_height;
+  gint focus;
+  gint y;
+  guint i, n;
+
+  focus = p_list_box_get_focus_size (list_box);
+  has_view = p_list_box_get_view_range (list_box, allocation, &view_start, &view_end);
+  priv->has_stale_rows = FALSE;
+  p_list_box_ensure_rows (list_box);
+
+  p_list_box_get_grid_item_size (list_box, &item_width, &item_height);
+  priv->grid_columns = p_list_box_get_grid_columns (allocation->width, item_width);
+  priv->grid_band_height = item_height;
+  priv->grid_rows = g_renew (guint, priv->grid_rows, priv->n_rows);
+  priv->grid_ordinal = g_renew (guint, priv->grid_ordinal, priv->n_rows);
+  priv->n_grid = 0;
+  priv->n_sections = 0;
+  y = 0;
+
+  for (i = 0; i < priv->n_rows; i++)
+    {
+      child_info = priv->row_info[i];
+      priv->row_separator_height[i] = 0;
+
+      /* Hidden rows sit at the end of the tile before them, which
+	 keeps the row ends sorted */
+      if (!child_info_is_visible (child_info))
+	{
+	  priv->row_y[i] = y;
+	  priv->row_height[i] = 0;
+	  priv->row_flags[i] = 0;
+	  priv->grid_ordinal[i] = G_MAXUINT;
+	  continue;
+	}
+
+      n = priv->n_grid++;
+      priv->grid_rows[n] = i;
+      priv->grid_ordinal[i] = n;
+      priv->row_y[i] = (gint) (n / priv->grid_columns) * item_height;
+      priv->row_height[i] = item_height;
+      priv->row_flags[i] = ROW_VISIBLE;
+      y = priv->row_y[i] + item_height;
+
+      if (child_info->widget == NULL)
+	continue;
+
+      if (!has_view ||
+	  child_info->has_windows ||
+	  (priv->row_y[i] < view_end && y > view_start))
+	p_list_box_allocate_row (list_box, i, allocation->width, focus);
+      else
+	{
+	  priv->row_flags[i] |= ROW_ALLOC_STALE;
+	  priv->has_stale_rows = TRUE;
+	}
+    }
+}
+
+/**
+ * p_list_box_set_layout_mode:
+ * @self: An #PListBox.
+ * @mode: The new layout.
+ *
+ * Sets whether rows are stacked or laid out in a grid of equally
+ * sized tiles, with as many columns as fit. Sections and separators
+ * are not shown in a grid.
+ **/
+void
+p_list_box_set_layout_mode (PListBox *list_box,
+			     PListBoxLayoutMode mode)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  g_return_if_fail (list_box != NULL);
+
+  if (priv->layout_mode == mode)
+    return;
+
+  priv->layout_mode = mode;
+  priv->n_grid = 0;
+  p_list_box_drop_all_headers (list_box);
+  p_list_box_reseparate (list_box);
+
+  g_object_notify_by_pspec (G_OBJECT (list_box), properties[PROP_LAYOUT_MODE]);
+}
+
+/**
+ * p_list_box_get_layout_mode:
+ * @self: An #PListBox.
+ *
+ * Gets how rows are laid out.
+ *
+ * Return value: The #PListBoxLayoutMode.
+ **/
+PListBoxLayoutMode
+p_list_box_get_layout_mode (PListBox *list_box)
+{
+  g_return_val_if_fail (list_box != NULL, P_LIST_BOX_LAYOUT_LIST);
+
+  return list_box->priv->layout_mode;
+}
+
+/**
+ * p_list_box_set_grid_item_size:
+ * @self: An #PListBox.
+ * @width: The width of a tile, or -1.
+ * @height: The height of a tile, or -1.
+ *
+ * Sets the size of the tiles in grid mode. Where it is -1 the size of
+ * the first visible child is used, which cells don't have, so grids of
+ * cells should set both.
+ **/
+void
+p_list_box_set_grid_item_size (PListBox *list_box,
+				gint width,
+				gint height)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  g_return_if_fail (list_box != NULL);
+
+  priv->grid_item_width = width;
+  priv->grid_item_height = height;
+  if (priv->layout_mode == P_LIST_BOX_LAYOUT_GRID)
+    gtk_widget_queue_resize (GTK_WIDGET (list_box));
+}
+
+/* Reflow. When the width changes, rows in view are measured again right
+   away, and rows out of view keep their old height, marked
+   ROW_HEIGHT_STALE, until the width stays the same for a while. Which
+   rows are in view is only known for sure from the row at the top of
+   the view on, since the rows above it may change height, so the view
+   is anchored on that row. The size request and the allocation decide
+   alike, so they agree on the height of the list. */
+
+typedef struct
+{
+  gboolean active;
+  gint width;
+  guint anchor;
+  gint offset;
+  gint page;
+  gint view_start;
+  gint view_end;
+} PListBoxReflow;
+
+static void
+p_list_box_reflow_begin (PListBox *list_box,
+			  gint width,
+			  PListBoxReflow *reflow)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GtkAllocation allocation;
+  gint view_start, view_end;
+
+  reflow->active = FALSE;
+  if (width == priv->reflow_width && !priv->reflow_pending)
+    return;
+
+  gtk_widget_get_allocation (GTK_WIDGET (list_box), &allocation);
+  if (!p_list_box_get_view_range (list_box, &allocation, &view_start, &view_end))
+    return;
+
+  p_list_box_ensure_rows (list_box);
+  reflow->active = TRUE;
+  reflow->width = width;
+  reflow->anchor = p_list_box_bisect_rows (list_box, view_start);
+  reflow->offset = 0;
+  if (reflow->anchor < priv->n_rows)
+    reflow->offset = view_start - (priv->row_y[reflow->anchor] -
+				   priv->row_separator_height[reflow->anchor]);
+  reflow->page = view_end - view_start;
+  /* Nothing is in view before the anchor */
+  reflow->view_start = G_MAXINT;
+  reflow->view_end = G_MININT;
+}
+
+static void
+p_list_box_reflow_reach_anchor (PListBoxReflow *reflow,
+				 gint y)
+{
+  reflow->view_start = y + reflow->offset;
+  reflow->view_end = reflow->view_start + reflow->page;
+}
+
+/* Whether row i, starting at y, keeps its old height for now */
+static gboolean
+p_list_box_reflow_defer (PListBox *list_box,
+			  PListBoxReflow *reflow,
+			  guint i,
+			  gint y)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  if (!reflow->active)
+    return FALSE;
+
+  /* Rows that were not laid out before have no height to keep */
+  if ((priv->row_flags[i] & ROW_VISIBLE) == 0)
+    return FALSE;
+  if ((priv->row_flags[i] & ROW_HEIGHT_STALE) == 0 &&
+      reflow->width == priv->reflow_width)
+    return FALSE;
+
+  return y >= reflow->view_end ||
+    y + priv->row_separator_height[i] + priv->row_height[i] <= reflow->view_start;
+}
+
+static void
+p_list_box_reflow_anchor (PListBox *list_box,
+			   PListBoxReflow *reflow,
+			   GtkAllocation *allocation)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  gdouble value;
+
+  if (reflow->anchor >= priv->n_rows)
+    return;
+
+  value = allocation->y + priv->row_y[reflow->anchor] -
+    priv->row_separator_height[reflow->anchor] + reflow->offset;
+  if (value != gtk_adjustment_get_value (priv->adjustment))
+    gtk_adjustment_set_value (priv->adjustment, value);
+}
+
+/* Measures rows out of view for the current width, a slice at a time.
+   The heights are picked up by the next allocation, from the size
+   request cache. */
+static gboolean
+p_list_box_reflow_step (gpointer user_data)
+{
+  PListBox *list_box = user_data;
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *info;
+  gint64 start;
+  gint width;
+  guint i;
+
+  start = g_get_monotonic_time ();
+  width = priv->reflow_width - 2 * p_list_box_get_focus_size (list_box);
+  p_list_box_ensure_rows (list_box);
+
+  for (i = 0; i < priv->n_rows; i++)
+    {
+      if ((priv->row_flags[i] & ROW_HEIGHT_STALE) == 0)
+	continue;
+      if (g_get_monotonic_time () - start > REFLOW_BUDGET)
+	break;
+
+      info = priv->row_info[i];
+      if (info->widget != NULL)
+	gtk_widget_get_preferred_height_for_width (info->widget, width, NULL, NULL);
+      else
+	p_list_box_measure_cell (list_box, info, width);
+      priv->row_flags[i] &= ~ROW_HEIGHT_STALE;
+    }
+
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+  if (i < priv->n_rows)
+    return TRUE;
+
+  priv->reflow_id = 0;
+  return FALSE;
+}
+
+static gboolean
+p_list_box_reflow_settle (gpointer user_data)
+{
+  PListBox *list_box = user_data;
+
+  list_box->priv->reflow_id =
+    g_idle_add_full (G_PRIORITY_LOW, p_list_box_reflow_step, list_box, NULL);
+  return FALSE;
+}
+
+/* Row animations. A row that is added grows in and fades in, a row
+   that is removed is painted from a snapshot taken while it was still
+   there, which shrinks and fades out in front of the row that followed
+   it, so the widget can go right away. The allocation lays the rows out
+   at their full height, after that one tick callback for the whole list
+   only moves rows by the animated heights above them. */
+
+/* From clutter-easing.c, based on Robert Penner's
+ * infamous easing equations, MIT license.
+ */
+static double
+ease_out_cubic (double t)
+{
+  double p = t - 1;
+  return p * p * p + 1;
+}
+
+static void
+p_list_box_row_animation_free (PListBoxRowAnimation *animation)
+{
+  if (animation->info != NULL)
+    animation->info->animation = NULL;
+  if (animation->surface != NULL)
+    cairo_surface_destroy (animation->surface);
+  g_slice_free (PListBoxRowAnimation, animation);
+}
+
+static gint
+p_list_box_compare_row_animations (gconstpointer a, gconstpointer b)
+{
+  const PListBoxRowAnimation *animation1 = *(PListBoxRowAnimation * const *) a;
+  const PListBoxRowAnimation *animation2 = *(PListBoxRowAnimation * const *) b;
+
+  if (animation1->index != animation2->index)
+    return animation1->index < animation2->index ? -1 : 1;
+  /* Snapshots go in front of the row */
+  return (animation1->info != NULL) - (animation2->info != NULL);
+}
+
+/* Moves the rows by the animated heights above them. Only rows in view
+   are allocated, the others are marked stale. */
+static void
+p_list_box_apply_row_animations (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxRowAnimation *animation;
+  PListBoxChildInfo *child_info;
+  GtkAllocation allocation;
+  gboolean has_view;
+  gint view_start, view_end;
+  gint focus;
+  gint shift;
+  guint i, k, s;
+
+  if (!priv->anim_laid_out ||
+      priv->animations->len == 0 ||
+      priv->layout_mode != P_LIST_BOX_LAYOUT_LIST)
+    return;
+
+  gtk_widget_get_allocation (GTK_WIDGET (list_box), &allocation);
+  has_view = p_list_box_get_view_range (list_box, &allocation, &view_start, &view_end);
+  focus = p_list_box_get_focus_size (list_box);
+  shift = 0;
+  k = 0;
+  s = 0;
+
+  /* Nothing above the first animation moves */
+  animation = g_ptr_array_index (priv->animations, 0);
+  for (i = animation->index; i <= priv->n_rows; i++)
+    {
+      while (s < priv->n_sections && priv->section_info[s]->index <= i)
+	{
+	  priv->section_y[s] = priv->anim_section_y[s] + shift;
+	  s++;
+	}
+
+      for (; k < priv->animations->len; k++)
+	{
+	  animation = g_ptr_array_index (priv->animations, k);
+	  if (animation->index != i || animation->info != NULL)
+	    break;
+	  animation->y = shift + (i < priv->n_rows ?
+				  priv->anim_base_y[i] - priv->row_separator_height[i] :
+				  priv->anim_end_y);
+	  animation->visible_height = (gint) (animation->height * animation->progress + 0.5);
+	  shift += animation->visible_height;
+	}
+      if (i == priv->n_rows)
+	break;
+
+      priv->row_y[i] = priv->anim_base_y[i] + shift;
+      if (k < priv->animations->len &&
+	  (animation = g_ptr_array_index (priv->animations, k))->index == i)
+	{
+	  if (priv->row_flags[i] & ROW_VISIBLE)
+	    {
+	      priv->row_height[i] = (gint) (animation->height * animation->progress + 0.5);
+	      shift += priv->row_height[i] - animation->height;
+	    }
+	  k++;
+	}
+
+      child_info = priv->row_info[i];
+      if (child_info->widget == NULL ||
+	  (priv->row_flags[i] & ROW_VISIBLE) == 0)
+	continue;
+
+      if (!has_view ||
+	  child_info->has_windows ||
+	  (priv->row_y[i] - priv->row_separator_height[i] < view_end &&
+	   priv->row_y[i] + priv->row_height[i] > view_start))
+	p_list_box_allocate_row (list_box, i, allocation.width, focus);
+      else
+	{
+	  priv->row_flags[i] |= ROW_ALLOC_STALE;
+	  priv->has_stale_rows = TRUE;
+	}
+    }
+
+  p_list_box_update_headers (list_box);
+  gtk_widget_queue_draw (GTK_WIDGET (list_box));
+}
+
+/* Called by the allocation once the rows are laid out at full height,
+   ending at end_y */
+static void
+p_list_box_layout_row_animations (PListBox *list_box, gint end_y)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxRowAnimation *animation;
+  guint i, k;
+
+  for (k = 0; k < priv->animations->len; k++)
+    {
+      animation = g_ptr_array_index (priv->animations, k);
+      if (animation->info != NULL)
+	{
+	  /* Rows below a collapsed row just stop animating */
+	  i = animation->info->index;
+	  if (i >= priv->n_rows || priv->row_info[i] != animation->info)
+	    i = G_MAXUINT;
+	  else if ((priv->row_flags[i] & ROW_HEIGHT_STALE) == 0)
+	    animation->height = priv->row_height[i];
+	}
+      else
+	{
+	  i = priv->n_rows;
+	  if (animation->before != NULL &&
+	      animation->before->index < priv->n_rows &&
+	      priv->row_info[animation->before->index] == animation->before)
+	    i = animation->before->index;
+	}
+      animation->index = i;
+    }
+  g_ptr_array_sort (priv->animations, p_list_box_compare_row_animations);
+
+  priv->anim_base_y = g_renew (gint, priv->anim_base_y, MAX (priv->n_rows, 1));
+  memcpy (priv->anim_base_y, priv->row_y, priv->n_rows * sizeof (gint));
+  priv->anim_section_y = g_renew (gint, priv->anim_section_y, MAX (priv->n_sections, 1));
+  if (priv->n_sections > 0)
+    memcpy (priv->anim_section_y, priv->section_y, priv->n_sections * sizeof (gint));
+  priv->anim_end_y = end_y;
+  priv->anim_laid_out = TRUE;
+
+  p_list_box_apply_row_animations (list_box);
+}
+
+static gboolean
+p_list_box_animation_tick (PListBox *list_box,
+			    GdkFrameClock *frame_clock,
+			    gpointer user_data)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxRowAnimation *animation;
+  gboolean done;
+  gint64 now;
+  gdouble t;
+  guint k;
+
+  now = gdk_frame_clock_get_frame_time (frame_clock);
+  done = TRUE;
+
+  for (k = 0; k < priv->animations->len; k++)
+    {
+      animation = g_ptr_array_index (priv->animations, k);
+      t = 1.0;
+      if (priv->animation_duration > 0)
+	t = (now - animation->start_time) / (priv->animation_duration * 1000.0);
+
+      /* Finish early if not mapped anymore */
+      if (!gtk_widget_get_mapped (GTK_WIDGET (list_box)) ||
+	  priv->layout_mode != P_LIST_BOX_LAYOUT_LIST)
+	t = 1.0;
+
+      t = CLAMP (t, 0.0, 1.0);
+      if (t < 1.0)
+	done = FALSE;
+      animation->progress = ease_out_cubic (t);
+      if (animation->info == NULL)
+	animation->progress = 1.0 - animation->progress;
+    }
+
+  p_list_box_apply_row_animations (list_box);
+  if (!done)
+    return TRUE;
+
+  /* Snapshots no longer take room */
+  g_ptr_array_set_size (priv->animations, 0);
+  priv->animation_tick_id = 0;
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+  return FALSE;
+}
+
+static gboolean
+p_list_box_can_animate_rows (PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  return priv->animation_duration > 0 &&
+    priv->layout_mode == P_LIST_BOX_LAYOUT_LIST &&
+    priv->animations->len < MAX_ROW_ANIMATIONS &&
+    gtk_widget_get_mapped (GTK_WIDGET (list_box));
+}
+
+static void
+p_list_box_add_row_animation (PListBox *list_box,
+			       PListBoxRowAnimation *animation)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  animation->start_time =
+    gdk_frame_clock_get_frame_time (gtk_widget_get_frame_clock (GTK_WIDGET (list_box)));
+  animation->index = G_MAXUINT;
+  g_ptr_array_add (priv->animations, animation);
+
+  /* Waits for the allocation to sort it in */
+  priv->anim_laid_out = FALSE;
+  gtk_widget_queue_resize (GTK_WIDGET (list_box));
+  if (priv->animation_tick_id == 0)
+    priv->animation_tick_id =
+      gtk_widget_add_tick_callback (GTK_WIDGET (list_box),
+				    (GtkTickCallback) p_list_box_animation_tick,
+				    list_box, NULL);
+}
+
+static void
+p_list_box_animate_insertion (PListBox *list_box,
+			       PListBoxChildInfo *info)
+{
+  PListBoxRowAnimation *animation;
+
+  if (!p_list_box_can_animate_rows (list_box))
+    return;
+
+  animation = g_slice_new0 (PListBoxRowAnimation);
+  animation->info = info;
+  info->animation = animation;
+  p_list_box_add_row_animation (list_box, animation);
+}
+
+/* Takes a snapshot of a row that is about to be removed, if it is
+   in view */
+static void
+p_list_box_animate_removal (PListBox *list_box,
+			     PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxRowAnimation *animation;
+  GtkAllocation allocation;
+  GSequenceIter *next;
+  gint view_start, view_end;
+  gint top, height;
+  guint i;
+  cairo_t *cr;
+
+  i = info->index;
+  if (!p_list_box_can_animate_rows (list_box) ||
+      i >= priv->n_rows || priv->row_info[i] != info ||
+      (priv->row_flags[i] & (ROW_VISIBLE | ROW_ALLOC_STALE)) != ROW_VISIBLE)
+    return;
+
+  gtk_widget_get_allocation (GTK_WIDGET (list_box), &allocation);
+  top = priv->row_y[i] - priv->row_separator_height[i];
+  height = priv->row_separator_height[i] + priv->row_height[i];
+  if (height <= 0 ||
+      (p_list_box_get_view_range (list_box, &allocation, &view_start, &view_end) &&
+       (top >= view_end || top + height <= view_start)))
+    return;
+
+  animation = g_slice_new0 (PListBoxRowAnimation);
+  animation->surface =
+    gdk_window_create_similar_surface (gtk_widget_get_window (GTK_WIDGET (list_box)),
+				       CAIRO_CONTENT_COLOR_ALPHA,
+				       allocation.width, height);
+  cr = cairo_create (animation->surface);
+  cairo_translate (cr, 0, -top);
+  if (info->widget == NULL)
+    p_list_box_draw_cell (list_box, info, cr,
+			  gtk_widget_get_state_flags (GTK_WIDGET (list_box)),
+			  allocation.width, p_list_box_get_focus_size (list_box));
+  else
+    {
+      if (info->separator != NULL)
+	gtk_container_propagate_draw (GTK_CONTAINER (list_box), info->separator, cr);
+      gtk_container_propagate_draw (GTK_CONTAINER (list_box), info->widget, cr);
+    }
+  cairo_destroy (cr);
+
+  animation->height = height;
+  animation->progress = 1.0;
+  animation->y = top;
+  animation->visible_height = height;
+  next = g_sequence_iter_next (info->iter);
+  if (!g_sequence_iter_is_end (next))
+    animation->before = g_sequence_get (next);
+  p_list_box_add_row_animation (list_box, animation);
+}
+
+/* Drops the animation of a row that goes away, snapshots in front of
+   it move on to the row after it */
+static void
+p_list_box_forget_row_animation (PListBox *list_box,
+				  PListBoxChildInfo *info)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxRowAnimation *animation;
+  PListBoxChildInfo *next_info;
+  GSequenceIter *next;
+  guint k;
+
+  if (priv->animations->len == 0)
+    return;
+
+  next_info = NULL;
+  next = g_sequence_iter_next (info->iter);
+  if (!g_sequence_iter_is_end (next))
+    next_info = g_sequence_get (next);
+
+  for (k = 0; k < priv->animations->len; k++)
+    {
+      animation = g_ptr_array_index (priv->animations, k);
+      if (animation->before == info)
+	animation->before = next_info;
+    }
+
+  if (info->animation != NULL)
+    {
+      g_ptr_array_remove (priv->animations, info->animation);
+      priv->anim_laid_out = FALSE;
+    }
+}
+
+/* Draws a growing row at its full size, clipped to the height it has
+   so far and faded in as far as it got */
+static void
+p_list_box_draw_animated_row (PListBox *list_box,
+			       PListBoxChildInfo *info,
+			       cairo_t *cr,
+			       GtkStateFlags state,
+			       gint width,
+			       gint focus)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  guint i = info->index;
+
+  cairo_save (cr);
+  cairo_rectangle (cr, 0, priv->row_y[i] - priv->row_separator_height[i],
+		   width, priv->row_separator_height[i] + priv->row_height[i]);
+  cairo_clip (cr);
+  cairo_push_group (cr);
+  if (info->widget == NULL)
+    p_list_box_draw_cell (list_box, info, cr, state, width, focus);
+  else
+    {
+      if (info->separator != NULL)
+	gtk_container_propagate_draw (GTK_CONTAINER (list_box), info->separator, cr);
+      gtk_container_propagate_draw (GTK_CONTAINER (list_box), info->widget, cr);
+    }
+  cairo_pop_group_to_source (cr);
+  cairo_paint_with_alpha (cr, info->animation->progress);
+  cairo_restore (cr);
+}
+
+/**
+ * p_list_box_set_row_animation_duration:
+ * @self: An #PListBox.
+ * @duration: The length of the animations in milliseconds, or 0.
+ *
+ * Sets how long added rows take to grow in and removed rows take to
+ * shrink away. The default of 0 turns that off. Rows only animate in
+ * list mode, and only while the list box is mapped.
+ **/
+void
+p_list_box_set_row_animation_duration (PListBox *list_box,
+					guint duration)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  g_return_if_fail (list_box != NULL);
+
+  priv->animation_duration = duration;
+}
+
+/* Export. Rows are measured for the page width and drawn one after the
+   other onto the pages, nothing is kept but the current row. A widget
+   row is allocated at the page width just while it is drawn and gets
+   its old allocation back afterwards. */
+
+typedef struct
+{
+  cairo_t *cr;
+  gint width;
+  gint page_height;
+  /* Where the next row goes on the current page */
+  gint y;
+  guint page;
+  gboolean page_started;
+  gboolean cancelled;
+  PListBoxPageFunc page_done;
+  gpointer page_done_target;
+} PListBoxExport;
+
+/* Cells keep the height for the width on screen, so that is only
+   used if the widths are the same */
+static gint
+p_list_box_export_measure_cell (PListBox *list_box,
+				 PListBoxChildInfo *info,
+				 gint width)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  if (info->cell_width == width)
+    return info->cell_height;
+  if (priv->cell_funcs.measure == NULL)
+    return 0;
+  return priv->cell_funcs.measure (list_box, info->cell_data, width,
+				   priv->cell_funcs_target);
+}
+
+static void
+p_list_box_export_end_page (PListBox *list_box,
+			     PListBoxExport *export)
+{
+  if (!export->page_started)
+    return;
+
+  if (!export->page_done (list_box, export->cr, export->page, export->page_done_target))
+    export->cancelled = TRUE;
+  export->page++;
+  export->y = 0;
+  export->page_started = FALSE;
 }
 
+/* Draws a widget, or a cell if widget is NULL, as a strip of inset +
+   height + inset rows. Strips go to the next page if they don't fit,
+   and are cut into pieces if they are taller than a page. */
 static void
-p_list_box_real_add (GtkContainer* container, GtkWidget* child)
+p_list_box_export_strip (PListBox *list_box,
+			  PListBoxExport *export,
+			  GtkWidget *widget,
+			  PListBoxChildInfo *info,
+			  gint inset,
+			  gint width,
+			  gint height)
 {
-  PListBox *list_box = P_LIST_BOX (container);
   PListBoxPrivate *priv = list_box->priv;
-  PListBoxChildInfo *info;
-  GSequenceIter* iter = NULL;
-  info = p_list_box_child_info_new (child);
-  g_hash_table_insert (priv->child_hash, child, info);
-  if (priv->sort_func != NULL)
-    iter = g_sequence_insert_sorted (priv->children, info,
-				     (GCompareDataFunc)do_sort, list_box);
-  else
-    iter = g_sequence_append (priv->children, info);
+  GtkAllocation old_allocation, allocation;
+  gint strip_height;
+  gint offset, rest;
 
-  info->iter = iter;
-  gtk_widget_set_parent (child, GTK_WIDGET (list_box));
-  p_list_box_apply_filter (list_box, child);
-  if (gtk_widget_get_visible (GTK_WIDGET (list_box)))
+  strip_height = height + 2 * inset;
+  if (strip_height <= 0)
+    return;
+  if (export->y > 0 && export->y + strip_height > export->page_height)
+    p_list_box_export_end_page (list_box, export);
+
+  if (widget != NULL)
     {
-      p_list_box_update_separator (list_box, iter);
-      p_list_box_update_separator (list_box, p_list_box_get_next_visible (list_box, iter));
+      gtk_widget_get_allocation (widget, &old_allocation);
+      allocation.x = old_allocation.x;
+      allocation.y = old_allocation.y;
+      allocation.width = width;
+      allocation.height = height;
+      gtk_widget_size_allocate (widget, &allocation);
+    }
+
+  for (offset = 0; !export->cancelled; offset += rest)
+    {
+      if (!export->page_started)
+	{
+	  gtk_render_background (gtk_widget_get_style_context (GTK_WIDGET (list_box)),
+				 export->cr, 0, 0, export->width, export->page_height);
+	  export->page_started = TRUE;
+	}
+
+      rest = MIN (strip_height - offset, export->page_height - export->y);
+      cairo_save (export->cr);
+      cairo_rectangle (export->cr, 0, export->y, export->width, rest);
+      cairo_clip (export->cr);
+      cairo_translate (export->cr, inset, export->y - offset + inset);
+      if (widget != NULL)
+	gtk_widget_draw (widget, export->cr);
+      else if (priv->cell_funcs.draw != NULL)
+	priv->cell_funcs.draw (list_box, info->cell_data, export->cr,
+			       width, height, GTK_STATE_FLAG_NORMAL,
+			       priv->cell_funcs_target);
+      else if (priv->cell_funcs.render != NULL)
+	priv->cell_funcs.render (list_box, info->cell_data, export->cr,
+				 width, height, priv->cell_funcs_target);
+      cairo_restore (export->cr);
+
+      export->y += rest;
+      if (offset + rest >= strip_height)
+	break;
+      p_list_box_export_end_page (list_box, export);
     }
-  g_signal_connect_object (child, "notify::visible",
-			   (GCallback) child_visibility_changed, list_box, 0);
+
+  if (widget != NULL)
+    gtk_widget_size_allocate (widget, &old_allocation);
 }
 
-static void
-p_list_box_real_remove (GtkContainer* container, GtkWidget* child)
+/**
+ * p_list_box_render_pages:
+ * @self: An #PListBox.
+ * @cr: The context to draw the pages on.
+ * @width: The width of a page.
+ * @page_height: The height of a page.
+ * @page_done: Called with @cr each time a page is full.
+ * @page_done_target: (allow-none): User data for @page_done.
+ *
+ * Draws the visible rows of @self in order onto pages of @width by
+ * @page_height, as a list without headers, at the top left of @cr.
+ * Rows are measured for @width, so the list does not need to be on
+ * screen or even realized, only widget rows need a toplevel, which
+ * may be a #GtkOffscreenWindow. Rows that don't fit on a page start
+ * the next one, rows taller than a page are cut.
+ *
+ * Once a page is drawn, @page_done is called, which would call
+ * cairo_show_page() for a PDF surface, or write out and clear an
+ * image surface. The page after it is drawn on @cr in the same place.
+ * If @page_done returns %FALSE no more pages are drawn.
+ *
+ * Return value: the number of pages drawn.
+ **/
+guint
+p_list_box_render_pages (PListBox *list_box,
+			  cairo_t *cr,
+			  gint width,
+			  gint page_height,
+			  PListBoxPageFunc page_done,
+			  void *page_done_target)
 {
-  PListBox *list_box = P_LIST_BOX (container);
   PListBoxPrivate *priv = list_box->priv;
-  gboolean was_visible;
   PListBoxChildInfo *info;
-  GSequenceIter *next;
+  PListBoxExport export = { 0 };
+  GSequenceIter *iter;
+  gint focus;
+  gint height;
 
-  g_return_if_fail (child != NULL);
-  was_visible = gtk_widget_get_visible (child);
+  g_return_val_if_fail (list_box != NULL, 0);
+  g_return_val_if_fail (cr != NULL, 0);
+  g_return_val_if_fail (width > 0 && page_height > 0, 0);
+  g_return_val_if_fail (page_done != NULL, 0);
 
-  g_signal_handlers_disconnect_by_func (child, (GCallback) child_visibility_changed, list_box);
+  export.cr = cr;
+  export.width = width;
+  export.page_height = page_height;
+  export.page_done = page_done;
+  export.page_done_target = page_done_target;
+  focus = p_list_box_get_focus_size (list_box);
 
-  info = p_list_box_lookup_info (list_box, child);
-  if (info == NULL)
+  for (iter = g_sequence_get_begin_iter (priv->children);
+       !g_sequence_iter_is_end (iter) && !export.cancelled;
+       iter = g_sequence_iter_next (iter))
     {
-      info = g_hash_table_lookup (priv->separator_hash, child);
-      if (info != NULL)
+      info = g_sequence_get (iter);
+      if (!child_info_is_visible (info))
+	continue;
+
+      if (info->widget == NULL)
 	{
-	  g_hash_table_remove (priv->separator_hash, child);
-	  g_clear_object (&info->separator);
-	  gtk_widget_unparent (child);
-	  if (was_visible && gtk_widget_get_visible (GTK_WIDGET (list_box)))
-	    gtk_widget_queue_resize (GTK_WIDGET (list_box));
+	  height = p_list_box_export_measure_cell (list_box, info, width - 2 * focus);
+	  p_list_box_export_strip (list_box, &export, NULL, info,
+				   focus, width - 2 * focus, height);
+	  continue;
 	}
-      else
+
+      if (info->separator != NULL)
 	{
-	  g_warning ("egg-list-box.vala:846: Tried to remove non-child %p\n", child);
+	  gtk_widget_get_preferred_height_for_width (info->separator, width, &height, NULL);
+	  p_list_box_export_strip (list_box, &export, info->separator, info,
+				   0, width, height);
 	}
-      return;
-    }
 
-  if (info->separator != NULL)
-    {
-      g_hash_table_remove (priv->separator_hash, info->separator);
-      gtk_widget_unparent (info->separator);
-      g_clear_object (&info->separator);
-    }
+      if (priv->update_columns_func != NULL &&
+	  info->columns_serial != priv->columns_serial)
+	{
+	  priv->update_columns_func (info->widget, priv->column_max, priv->n_columns,
+				     priv->update_columns_func_target);
+	  info->columns_serial = priv->columns_serial;
+	}
 
-  if (info == priv->selected_child)
-      p_list_box_update_selected (list_box, NULL);
-  if (info == priv->prelight_child)
-    priv->prelight_child = NULL;
-  if (info == priv->cursor_child)
-    priv->cursor_child = NULL;
-  if (info == priv->active_child)
-    priv->active_child = NULL;
+      gtk_widget_get_preferred_height_for_width (info->widget, width - 2 * focus,
+						 &height, NULL);
+      p_list_box_export_strip (list_box, &export, info->widget, info,
+			       focus, width - 2 * focus, height);
+    }
 
-  next = p_list_box_get_next_visible (list_box, info->iter);
-  gtk_widget_unparent (child);
-  g_hash_table_remove (priv->child_hash, child);
-  g_sequence_remove (info->iter);
-  if (gtk_widget_get_visible (GTK_WIDGET (list_box)))
-    p_list_box_update_separator (list_box, next);
+  if (!export.cancelled)
+    p_list_box_export_end_page (list_box, &export);
 
-  if (was_visible && gtk_widget_get_visible (GTK_WIDGET (list_box)))
-    gtk_widget_queue_resize (GTK_WIDGET (list_box));
+  return export.page;
 }
 
-
 static void
 p_list_box_real_forall_internal (GtkContainer* container,
 				   gboolean include_internals,
@@ -1578,6 +6743,12 @@ p_list_box_real_forall_internal (GtkContainer* container,
   GSequenceIter *iter;
   PListBoxChildInfo *child_info;
 
+  if (priv->has_tree)
+    {
+      p_list_box_forall_tree (list_box, include_internals, callback, callback_target);
+      return;
+    }
+
   iter = g_sequence_get_begin_iter (priv->children);
   while (!g_sequence_iter_is_end (iter))
     {
@@ -1585,7 +6756,19 @@ p_list_box_real_forall_internal (GtkContainer* container,
       iter = g_sequence_iter_next (iter);
       if (child_info->separator != NULL && include_internals)
 	callback (child_info->separator, callback_target);
-      callback (child_info->widget, callback_target);
+      if (child_info->widget != NULL)
+	callback (child_info->widget, callback_target);
+    }
+
+  if (include_internals && g_hash_table_size (priv->headers) > 0)
+    {
+      GList *headers, *l;
+
+      /* The callback may well remove them */
+      headers = g_hash_table_get_values (priv->headers);
+      for (l = headers; l != NULL; l = l->next)
+	callback (l->data, callback_target);
+      g_list_free (headers);
     }
 }
 
@@ -1637,14 +6820,43 @@ p_list_box_real_get_preferred_height_for_width (GtkWidget* widget, gint width,
   GtkStyleContext *context;
   gint focus_width;
   gint focus_pad;
+  GQuark section;
+  gint item_width, item_height;
+  guint n_visible, cols;
+  PListBoxReflow reflow;
+  guint i;
 
   minimum_height = 0;
+  section = 0;
+
+  /* Only the number of tiles matters */
+  if (priv->layout_mode == P_LIST_BOX_LAYOUT_GRID)
+    {
+      p_list_box_get_grid_item_size (list_box, &item_width, &item_height);
+      n_visible = 0;
+      for (iter = g_sequence_get_begin_iter (priv->children);
+	   !g_sequence_iter_is_end (iter);
+	   iter = g_sequence_iter_next (iter))
+	if (child_info_is_visible (g_sequence_get (iter)))
+	  n_visible++;
+      cols = p_list_box_get_grid_columns (width, item_width);
+      minimum_height = (gint) ((n_visible + cols - 1) / cols) * item_height;
+      if (minimum_height_out)
+	*minimum_height_out = minimum_height;
+      if (natural_height_out)
+	*natural_height_out = minimum_height;
+      return;
+    }
 
   context = gtk_widget_get_style_context (GTK_WIDGET (list_box));
   gtk_style_context_get_style (context,
 			       "focus-line-width", &focus_width,
 			       "focus-padding", &focus_pad, NULL);
 
+  /* Same as the allocation will, rows out of view that were measured
+     for another width keep that height for now */
+  p_list_box_reflow_begin (list_box, width, &reflow);
+
   for (iter = g_sequence_get_begin_iter (priv->children);
        !g_sequence_iter_is_end (iter);
        iter = g_sequence_iter_next (iter))
@@ -1654,10 +6866,41 @@ p_list_box_real_get_preferred_height_for_width (GtkWidget* widget, gint width,
       gint child_min = 0;
       child_info = g_sequence_get (iter);
       child = child_info->widget;
+      i = child_info->index;
+      if (reflow.active && i == reflow.anchor)
+	p_list_box_reflow_reach_anchor (&reflow, minimum_height);
+
+      if (priv->create_header_func != NULL &&
+	  (child == NULL || child_is_visible (child)) &&
+	  child_info->section != section)
+	{
+	  section = child_info->section;
+	  if (section != 0)
+	    minimum_height += MAX (priv->header_height, 0);
+	}
+
+      if (child == NULL)
+	{
+	  if (p_list_box_reflow_defer (list_box, &reflow, i, minimum_height))
+	    {
+	      minimum_height += priv->row_height[i];
+	      continue;
+	    }
+	  minimum_height += p_list_box_measure_cell (list_box, child_info,
+						      width - 2 * (focus_width + focus_pad));
+	  minimum_height += 2 * (focus_width + focus_pad);
+	  continue;
+	}
 
       if (!child_is_visible (child))
 	continue;
 
+      if (p_list_box_reflow_defer (list_box, &reflow, i, minimum_height))
+	{
+	  minimum_height += priv->row_separator_height[i] + priv->row_height[i];
+	  continue;
+	}
+
       if (child_info->separator != NULL)
 	{
 	  gtk_widget_get_preferred_height_for_width (child_info->separator, width, &child_min, NULL);
@@ -1673,6 +6916,15 @@ p_list_box_real_get_preferred_height_for_width (GtkWidget* widget, gint width,
      be used, as lists are generally put inside a scrolling window
      anyway.
   */
+  /* Removed rows keep their room until they are gone */
+  for (i = 0; i < priv->animations->len; i++)
+    {
+      PListBoxRowAnimation *animation = g_ptr_array_index (priv->animations, i);
+
+      if (animation->info == NULL)
+	minimum_height += animation->height;
+    }
+
   natural_height = minimum_height;
   if (minimum_height_out)
     *minimum_height_out = minimum_height;
@@ -1702,13 +6954,26 @@ p_list_box_real_get_preferred_width (GtkWidget* widget, gint* minimum_width_out,
   minimum_width = 0;
   natural_width = 0;
 
+  /* At least one tile, more if there is room */
+  if (priv->layout_mode == P_LIST_BOX_LAYOUT_GRID)
+    {
+      p_list_box_get_grid_item_size (list_box, &minimum_width, &child_nat);
+      minimum_width = MAX (minimum_width, 0);
+      if (minimum_width_out)
+	*minimum_width_out = minimum_width;
+      if (natural_width_out)
+	*natural_width_out = minimum_width;
+      return;
+    }
+
   for (iter = g_sequence_get_begin_iter (priv->children);
        !g_sequence_iter_is_end (iter);
        iter = g_sequence_iter_next (iter))
     {
       child_info = g_sequence_get (iter);
       child = child_info->widget;
-      if (!child_is_visible (child))
+      /* Cells take whatever width they get */
+      if (child == NULL || !child_is_visible (child))
 	continue;
 
       gtk_widget_get_preferred_width (child, &child_min, &child_nat);
@@ -1737,32 +7002,199 @@ p_list_box_real_get_preferred_width_for_height (GtkWidget *widget, gint height,
   p_list_box_real_get_preferred_width (GTK_WIDGET (list_box), minimum_width, natural_width);
 }
 
+/* Moves row i and its separator to its stored geometry */
 static void
-p_list_box_real_size_allocate (GtkWidget *widget, GtkAllocation *allocation)
+p_list_box_allocate_row (PListBox *list_box,
+			  guint i,
+			  gint width,
+			  gint focus)
 {
-  PListBox *list_box = P_LIST_BOX (widget);
   PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *child_info = priv->row_info[i];
   GtkAllocation child_allocation;
   GtkAllocation separator_allocation;
-  PListBoxChildInfo *child_info;
-  GdkWindow *window;
-  GtkWidget *child;
-  GSequenceIter *iter;
+  gint x;
+
+  /* Tiles have no separators */
+  if (child_info->separator != NULL &&
+      priv->layout_mode == P_LIST_BOX_LAYOUT_LIST)
+    {
+      separator_allocation.x = 0;
+      separator_allocation.y = priv->row_y[i] - priv->row_separator_height[i];
+      separator_allocation.width = width;
+      separator_allocation.height = priv->row_separator_height[i];
+      gtk_widget_size_allocate (child_info->separator, &separator_allocation);
+    }
+
+  p_list_box_get_row_span (list_box, i, width, &x, &width);
+  child_allocation.x = x + focus;
+  child_allocation.y = priv->row_y[i] + focus;
+  child_allocation.width = width - 2 * focus;
+  child_allocation.height = priv->row_height[i];
+  /* A growing row gets its full height and is clipped when drawn */
+  if (child_info->animation != NULL)
+    child_allocation.height = MAX (child_allocation.height, child_info->animation->height);
+  child_allocation.height -= 2 * focus;
+  gtk_widget_size_allocate (child_info->widget, &child_allocation);
+
+  priv->row_flags[i] &= ~ROW_ALLOC_STALE;
+}
+
+/* Gets the part of the list that is scrolled into view. Returns FALSE
+   if that is not known, in which case everything counts as visible. */
+static gboolean
+p_list_box_get_view_range (PListBox *list_box,
+			    GtkAllocation *allocation,
+			    gint *view_start,
+			    gint *view_end)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  gdouble page_size;
+
+  if (priv->adjustment == NULL)
+    return FALSE;
+
+  page_size = gtk_adjustment_get_page_size (priv->adjustment);
+  if (page_size <= 0)
+    return FALSE;
+
+  *view_start = (gint) gtk_adjustment_get_value (priv->adjustment) - allocation->y;
+  *view_end = *view_start + (gint) page_size;
+  return TRUE;
+}
+
+static gint
+p_list_box_get_focus_size (PListBox *list_box)
+{
   GtkStyleContext *context;
   gint focus_width;
   gint focus_pad;
-  int child_min;
 
+  context = gtk_widget_get_style_context (GTK_WIDGET (list_box));
+  gtk_style_context_get_style (context,
+			       "focus-line-width", &focus_width,
+			       "focus-padding", &focus_pad,
+			       NULL);
+  return focus_width + focus_pad;
+}
+
+/* Cell heights are cached per width, asking the measure callback for
+   every cell on each resize would defeat the point of cells */
+static gint
+p_list_box_measure_cell (PListBox *list_box,
+			  PListBoxChildInfo *info,
+			  gint width)
+{
+  PListBoxPrivate *priv = list_box->priv;
+
+  if (info->cell_width != width)
+    {
+      info->cell_height = 0;
+      if (priv->cell_funcs.measure != NULL)
+	info->cell_height = priv->cell_funcs.measure (list_box, info->cell_data, width,
+						      priv->cell_funcs_target);
+      info->cell_width = width;
+    }
+
+  return info->cell_height;
+}
+
+static gboolean
+p_list_box_cell_hit_test (PListBox *list_box,
+			   PListBoxChildInfo *info,
+			   gint x,
+			   gint y)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  gint focus;
+  gint row_x, row_width;
+
+  if (priv->cell_funcs.hit_test == NULL)
+    return TRUE;
+
+  focus = p_list_box_get_focus_size (list_box);
+  y -= row_get_y (list_box, info);
+  p_list_box_get_row_span (list_box, info->index,
+			   gtk_widget_get_allocated_width (GTK_WIDGET (list_box)),
+			   &row_x, &row_width);
+  return priv->cell_funcs.hit_test (list_box, info->cell_data,
+				    x - row_x - focus, y - focus,
+				    priv->cell_funcs_target);
+}
+
+/* Catches up on rows that scrolled into view since the last allocation */
+static void
+p_list_box_adjustment_changed (GtkAdjustment *adjustment,
+				PListBox *list_box)
+{
+  PListBoxPrivate *priv = list_box->priv;
+  GtkAllocation allocation;
+  gboolean has_stale_rows;
+  gint view_start, view_end;
+  gint focus;
+  guint i;
+
+  p_list_box_prefetch_tiles (list_box);
+  p_list_box_trim_cell_accessibles (list_box);
+  p_list_box_update_headers (list_box);
+
+  if (!priv->has_stale_rows)
+    return;
+
+  gtk_widget_get_allocation (GTK_WIDGET (list_box), &allocation);
+  if (!p_list_box_get_view_range (list_box, &allocation, &view_start, &view_end))
+    {
+      view_start = G_MININT;
+      view_end = G_MAXINT;
+    }
+
+  focus = p_list_box_get_focus_size (list_box);
+  has_stale_rows = FALSE;
+  p_list_box_ensure_rows (list_box);
+
+  for (i = 0; i < priv->n_rows; i++)
+    {
+      if ((priv->row_flags[i] & ROW_ALLOC_STALE) == 0)
+	continue;
+
+      if (priv->row_y[i] - priv->row_separator_height[i] < view_end &&
+	  priv->row_y[i] + priv->row_height[i] > view_start)
+	{
+	  p_list_box_allocate_row (list_box, i, allocation.width, focus);
+	  gtk_widget_queue_draw (GTK_WIDGET (list_box));
+	}
+      else
+	has_stale_rows = TRUE;
+    }
 
-  child_allocation.x = 0;
-  child_allocation.y = 0;
-  child_allocation.width = 0;
-  child_allocation.height = 0;
+  priv->has_stale_rows = has_stale_rows;
+}
 
-  separator_allocation.x = 0;
-  separator_allocation.y = 0;
-  separator_allocation.width = 0;
-  separator_allocation.height = 0;
+/* Row heights come from the size request cache, so unless the width
+   changed only rows that queued a resize are really measured again.
+   Allocating a row is what costs, since it walks all of its
+   descendants, so rows outside the viewport just get their new
+   position recorded and are moved once they scroll into view. This
+   keeps a row animating its height in a long list from reallocating
+   every row below it on each frame. */
+static void
+p_list_box_real_size_allocate (GtkWidget *widget, GtkAllocation *allocation)
+{
+  PListBox *list_box = P_LIST_BOX (widget);
+  PListBoxPrivate *priv = list_box->priv;
+  PListBoxChildInfo *child_info;
+  GdkWindow *window;
+  GtkWidget *child;
+  gboolean has_view;
+  gint view_start, view_end;
+  gint focus;
+  gint child_width;
+  gint header_height;
+  gint y;
+  guint i, n_sections;
+  int child_min;
+  PListBoxReflow reflow;
+  gboolean deferred;
 
   gtk_widget_set_allocation (GTK_WIDGET (list_box), allocation);
   window = gtk_widget_get_window (GTK_WIDGET (list_box));
@@ -1771,52 +7203,156 @@ p_list_box_real_size_allocate (GtkWidget *widget, GtkAllocation *allocation)
 			    allocation->x, allocation->y,
 			    allocation->width, allocation->height);
 
-  context = gtk_widget_get_style_context (GTK_WIDGET (list_box));
-  gtk_style_context_get_style (context,
-			       "focus-line-width", &focus_width,
-			       "focus-padding", &focus_pad,
-			       NULL);
-  child_allocation.x = 0 + focus_width + focus_pad;
-  child_allocation.y = 0;
-  child_allocation.width = allocation->width - 2 * (focus_width + focus_pad);
-  separator_allocation.x = 0;
-  separator_allocation.width = allocation->width;
+  if (priv->layout_mode == P_LIST_BOX_LAYOUT_GRID)
+    {
+      p_list_box_allocate_grid (list_box, allocation);
+      return;
+    }
 
-  for (iter = g_sequence_get_begin_iter (priv->children);
-       !g_sequence_iter_is_end (iter);
-       iter = g_sequence_iter_next (iter))
+  focus = p_list_box_get_focus_size (list_box);
+  child_width = allocation->width - 2 * focus;
+  has_view = p_list_box_get_view_range (list_box, allocation, &view_start, &view_end);
+  priv->has_stale_rows = FALSE;
+  p_list_box_ensure_rows (list_box);
+  y = 0;
+
+  /* While the width changes only rows in view are measured again, the
+     others keep their old height until the width settled. The view is
+     kept on the row at its top, which is where it starts again. */
+  p_list_box_reflow_begin (list_box, allocation->width, &reflow);
+  if (reflow.active)
     {
-      child_info = g_sequence_get (iter);
+      view_start = G_MAXINT;
+      view_end = G_MININT;
+    }
+  if (allocation->width != priv->reflow_width)
+    {
+      for (i = 0; i < priv->n_rows; i++)
+	if (priv->row_flags[i] & ROW_VISIBLE)
+	  priv->row_flags[i] |= ROW_HEIGHT_STALE;
+      priv->reflow_width = allocation->width;
+      if (priv->reflow_id != 0)
+	{
+	  g_source_remove (priv->reflow_id);
+	  priv->reflow_id = 0;
+	}
+    }
+  deferred = FALSE;
+
+  header_height = 0;
+  if (priv->create_header_func != NULL)
+    {
+      header_height = p_list_box_get_header_height (list_box, allocation->width);
+      priv->section_info = g_renew (PListBoxChildInfo *, priv->section_info, priv->n_rows);
+      priv->section_y = g_renew (gint, priv->section_y, priv->n_rows);
+    }
+  n_sections = 0;
+
+  for (i = 0; i < priv->n_rows; i++)
+    {
+      child_info = priv->row_info[i];
       child = child_info->widget;
-      if (!child_is_visible (child))
+      if (reflow.active && i == reflow.anchor)
 	{
-	  child_info->y = child_allocation.y;
-	  child_info->height = 0;
-	  continue;
+	  p_list_box_reflow_reach_anchor (&reflow, y);
+	  view_start = reflow.view_start;
+	  view_end = reflow.view_end;
 	}
 
-      if (child_info->separator != NULL)
+      /* A visible row with another section name than the one before
+	 starts a section, and gets a header unless it has no name */
+      if (priv->create_header_func != NULL &&
+	  (child == NULL || child_is_visible (child)) &&
+	  (n_sections == 0 ||
+	   priv->section_info[n_sections - 1]->section != child_info->section))
 	{
-	  gtk_widget_get_preferred_height_for_width (child_info->separator,
-						     allocation->width, &child_min, NULL);
-	  separator_allocation.height = child_min;
-	  separator_allocation.y = child_allocation.y;
-	  gtk_widget_size_allocate (child_info->separator,
-				    &separator_allocation);
-	  child_allocation.y += child_min;
+	  priv->section_info[n_sections] = child_info;
+	  priv->section_y[n_sections] = y;
+	  n_sections++;
+	  if (child_info->section != 0)
+	    y += header_height;
 	}
 
-      child_info->y = child_allocation.y;
-      child_allocation.y += focus_width + focus_pad;
+      if (child == NULL)
+	{
+	  priv->row_separator_height[i] = 0;
+	  priv->row_y[i] = y;
+	  if (p_list_box_reflow_defer (list_box, &reflow, i, y))
+	    {
+	      priv->row_flags[i] = ROW_VISIBLE | ROW_HEIGHT_STALE;
+	      deferred = TRUE;
+	    }
+	  else
+	    {
+	      priv->row_height[i] = p_list_box_measure_cell (list_box, child_info, child_width) + 2 * focus;
+	      priv->row_flags[i] = ROW_VISIBLE;
+	    }
+	  y += priv->row_height[i];
+	  continue;
+	}
+      if (!child_is_visible (child))
+	{
+	  priv->row_separator_height[i] = 0;
+	  priv->row_y[i] = y;
+	  priv->row_height[i] = 0;
+	  priv->row_flags[i] = 0;
+	  continue;
+	}
 
-      gtk_widget_get_preferred_height_for_width (child, child_allocation.width, &child_min, NULL);
-      child_allocation.height = child_min;
+      if (p_list_box_reflow_defer (list_box, &reflow, i, y))
+	{
+	  priv->row_y[i] = y + priv->row_separator_height[i];
+	  priv->row_flags[i] = ROW_VISIBLE | ROW_HEIGHT_STALE;
+	  deferred = TRUE;
+	}
+      else
+	{
+	  priv->row_separator_height[i] = 0;
+	  if (child_info->separator != NULL)
+	    {
+	      gtk_widget_get_preferred_height_for_width (child_info->separator,
+							 allocation->width, &child_min, NULL);
+	      priv->row_separator_height[i] = child_min;
+	    }
 
-      child_info->height = child_allocation.height + 2 * (focus_width + focus_pad);
-      gtk_widget_size_allocate (child, &child_allocation);
+	  /* Before measuring, the widths may change the height */
+	  if (priv->update_columns_func != NULL &&
+	      child_info->columns_serial != priv->columns_serial)
+	    {
+	      priv->update_columns_func (child, priv->column_max, priv->n_columns,
+					 priv->update_columns_func_target);
+	      child_info->columns_serial = priv->columns_serial;
+	    }
 
-      child_allocation.y += child_min + focus_width + focus_pad;
+	  gtk_widget_get_preferred_height_for_width (child, child_width, &child_min, NULL);
+	  priv->row_y[i] = y + priv->row_separator_height[i];
+	  priv->row_height[i] = child_min + 2 * focus;
+	  priv->row_flags[i] = ROW_VISIBLE;
+	}
+      y = priv->row_y[i] + priv->row_height[i];
+
+      /* Windowed rows would show up at their old position */
+      if (!has_view ||
+	  child_info->has_windows ||
+	  (priv->row_y[i] - priv->row_separator_height[i] < view_end &&
+	   priv->row_y[i] + priv->row_height[i] > view_start))
+	p_list_box_allocate_row (list_box, i, allocation->width, focus);
+      else
+	{
+	  priv->row_flags[i] |= ROW_ALLOC_STALE;
+	  priv->has_stale_rows = TRUE;
+	}
     }
+
+  priv->n_sections = n_sections;
+  if (priv->animations->len > 0)
+    p_list_box_layout_row_animations (list_box, y);
+  priv->reflow_pending = deferred;
+  if (deferred && priv->reflow_id == 0)
+    priv->reflow_id = g_timeout_add (REFLOW_DELAY, p_list_box_reflow_settle, list_box);
+  if (reflow.active)
+    p_list_box_reflow_anchor (list_box, &reflow, allocation);
+  p_list_box_update_headers (list_box);
 }
 
 void
@@ -1978,10 +7514,13 @@ p_list_box_real_move_cursor (PListBox *list_box,
   PListBoxChildInfo *next;
   gint page_size;
   GSequenceIter *iter;
+  gboolean grid;
   gint start_y;
   gint end_y;
+  gint bands;
 
   modify_selection_pressed = FALSE;
+  grid = priv->layout_mode == P_LIST_BOX_LAYOUT_GRID;
 
   if (gtk_get_current_event_state (&state))
     {
@@ -2001,7 +7540,10 @@ p_list_box_real_move_cursor (PListBox *list_box,
 	child = p_list_box_get_last_visible (list_box);
       break;
     case GTK_MOVEMENT_DISPLAY_LINES:
-      if (priv->cursor_child != NULL)
+      if (priv->cursor_child != NULL && grid)
+	child = p_list_box_grid_offset (list_box, priv->cursor_child,
+					count * (gint) priv->grid_columns);
+      else if (priv->cursor_child != NULL)
 	{
 	  iter = priv->cursor_child->iter;
 
@@ -2025,9 +7567,23 @@ p_list_box_real_move_cursor (PListBox *list_box,
       if (priv->adjustment != NULL)
 	page_size = gtk_adjustment_get_page_increment (priv->adjustment);
 
-      if (priv->cursor_child != NULL)
+      /* Whole bands, keeping the column */
+      if (priv->cursor_child != NULL && grid)
+	{
+	  start_y = row_get_y (list_box, priv->cursor_child);
+	  bands = 1;
+	  if (priv->grid_band_height > 0)
+	    bands = MAX (page_size / priv->grid_band_height, 1);
+	  child = p_list_box_grid_offset (list_box, priv->cursor_child,
+					  count * bands * (gint) priv->grid_columns);
+	  if (child != NULL && priv->adjustment != NULL)
+	    gtk_adjustment_set_value (priv->adjustment,
+				      gtk_adjustment_get_value (priv->adjustment) +
+				      row_get_y (list_box, child) - start_y);
+	}
+      else if (priv->cursor_child != NULL)
 	{
-	  start_y = priv->cursor_child->y;
+	  start_y = row_get_y (list_box, priv->cursor_child);
 	  end_y = start_y;
 	  iter = priv->cursor_child->iter;
 
@@ -2042,7 +7598,7 @@ p_list_box_real_move_cursor (PListBox *list_box,
 		    break;
 
 		  prev = g_sequence_get (iter);
-		  if (prev->y < start_y - page_size)
+		  if (row_get_y (list_box, prev) < start_y - page_size)
 		    break;
 
 		  child = prev;
@@ -2058,19 +7614,27 @@ p_list_box_real_move_cursor (PListBox *list_box,
 		    break;
 
 		  next = g_sequence_get (iter);
-		  if (next->y > start_y + page_size)
+		  if (row_get_y (list_box, next) > start_y + page_size)
 		    break;
 
 		  child = next;
 		}
 	    }
-	  end_y = child->y;
+	  end_y = row_get_y (list_box, child);
 	  if (end_y != start_y && priv->adjustment != NULL)
 	    gtk_adjustment_set_value (priv->adjustment,
 				      gtk_adjustment_get_value (priv->adjustment) +
 				      end_y - start_y);
 	}
       break;
+    case GTK_MOVEMENT_VISUAL_POSITIONS:
+      if (!grid)
+	return;
+      if (gtk_widget_get_direction (GTK_WIDGET (list_box)) == GTK_TEXT_DIR_RTL)
+	count = -count;
+      if (priv->cursor_child != NULL)
+	child = p_list_box_grid_offset (list_box, priv->cursor_child, count);
+      break;
     default:
       return;
     }
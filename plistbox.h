@@ -6,6 +6,13 @@
 
 G_BEGIN_DECLS
 
+typedef enum {
+  P_LIST_BOX_LAYOUT_LIST,
+  P_LIST_BOX_LAYOUT_GRID
+} PListBoxLayoutMode;
+
+#define P_TYPE_LIST_BOX_LAYOUT_MODE (p_list_box_layout_mode_get_type ())
+GType p_list_box_layout_mode_get_type (void);
 
 #define P_TYPE_LIST_BOX (p_list_box_get_type ())
 #define P_LIST_BOX(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), P_TYPE_LIST_BOX, PListBox))
@@ -17,6 +24,8 @@ G_BEGIN_DECLS
 typedef struct _PListBox PListBox;
 typedef struct _PListBoxClass PListBoxClass;
 typedef struct _PListBoxPrivate PListBoxPrivate;
+typedef struct _PListBoxCell PListBoxCell;
+typedef struct _PListBoxCellFuncs PListBoxCellFuncs;
 
 struct _PListBox
 {
@@ -38,11 +47,31 @@ struct _PListBoxClass
 typedef gboolean (*PListBoxFilterFunc) (GtkWidget* child, void* user_data);
 typedef gint (*PListBoxSortFunc) (GtkWidget* child1, GtkWidget* child2, void* user_data);
 typedef void (*PListBoxUpdateSeparatorFunc) (GtkWidget** separator, GtkWidget* child, GtkWidget* before, void* user_data);
+typedef GtkWidget* (*PListBoxCreateChildFunc) (gpointer item, void* user_data);
+typedef void (*PListBoxCellRenderFunc) (PListBox* self, gpointer cell_data, cairo_t* cr, gint width, gint height, void* user_data);
+typedef gint (*PListBoxCellSortFunc) (gpointer cell_data1, gpointer cell_data2, void* user_data);
+typedef GtkWidget* (*PListBoxCreateHeaderFunc) (PListBox* self, const gchar* section, void* user_data);
+typedef gchar* (*PListBoxSearchKeyFunc) (GtkWidget* child, void* user_data);
+typedef void (*PListBoxUpdateColumnsFunc) (GtkWidget* child, const gint* column_widths, guint n_columns, void* user_data);
+typedef void (*PListBoxLoadChildrenFunc) (PListBox* self, GtkWidget* parent, void* user_data);
+typedef gboolean (*PListBoxPageFunc) (PListBox* self, cairo_t* cr, guint page, void* user_data);
+
+struct _PListBoxCellFuncs
+{
+  gint (*measure) (PListBox* self, gpointer cell_data, gint width, void* user_data);
+  void (*draw) (PListBox* self, gpointer cell_data, cairo_t* cr, gint width, gint height, GtkStateFlags state, void* user_data);
+  gboolean (*hit_test) (PListBox* self, gpointer cell_data, gint x, gint y, void* user_data);
+  PListBoxCellRenderFunc render;
+  gchar* (*describe) (PListBox* self, gpointer cell_data, void* user_data);
+};
 
 GType p_list_box_get_type (void) G_GNUC_CONST;
 GtkWidget*  p_list_box_get_selected_child           (PListBox                    *self);
 GtkWidget*  p_list_box_get_child_at_y               (PListBox                    *self,
 						       gint                           y);
+GtkWidget*  p_list_box_get_child_at_pos             (PListBox                    *self,
+						       gint                           x,
+						       gint                           y);
 void        p_list_box_select_child                 (PListBox                    *self,
 						       GtkWidget                     *child);
 void        p_list_box_set_adjustment               (PListBox                    *self,
@@ -68,6 +97,107 @@ void        p_list_box_set_sort_func                (PListBox
 						       GDestroyNotify                 f_target_destroy_notify);
 void        p_list_box_child_changed                (PListBox                    *self,
 						       GtkWidget                     *widget);
+void        p_list_box_remove_all                   (PListBox                    *self);
+void        p_list_box_remove_matching              (PListBox                    *self,
+						       PListBoxFilterFunc           predicate,
+						       void                          *predicate_target);
+void        p_list_box_set_child_row_type           (PListBox                    *self,
+						       GtkWidget                     *child,
+						       const gchar                   *row_type);
+GtkWidget * p_list_box_obtain_child                 (PListBox                    *self,
+						       const gchar                   *row_type);
+void        p_list_box_set_recycle_limit            (PListBox                    *self,
+						       guint                          limit);
+void        p_list_box_trim_recycled                (PListBox                    *self);
+void        p_list_box_set_child_factory            (PListBox                    *self,
+						       PListBoxCreateChildFunc      create_child,
+						       void                          *create_child_target,
+						       GDestroyNotify                 create_child_target_destroy_notify,
+						       GDestroyNotify                 item_destroy_notify);
+void        p_list_box_push_item                    (PListBox                    *self,
+						       gpointer                       item);
+void        p_list_box_set_feed_budget              (PListBox                    *self,
+						       guint                          budget_usec);
+void        p_list_box_set_cell_funcs               (PListBox                    *self,
+						       const PListBoxCellFuncs     *funcs,
+						       void                          *funcs_target,
+						       GDestroyNotify                 funcs_target_destroy_notify,
+						       GDestroyNotify                 cell_data_destroy_notify);
+void        p_list_box_set_cell_data_destroy_notify (PListBox                    *self,
+						       GDestroyNotify                 cell_data_destroy_notify);
+PListBoxCell * p_list_box_add_cell                  (PListBox                    *self,
+						       gpointer                       cell_data);
+void        p_list_box_remove_cell                  (PListBox                    *self,
+						       PListBoxCell                *cell);
+void        p_list_box_cell_changed                 (PListBox                    *self,
+						       PListBoxCell                *cell);
+void        p_list_box_cell_set_data                (PListBox                    *self,
+						       PListBoxCell                *cell,
+						       gpointer                       cell_data);
+gpointer    p_list_box_cell_get_data                (PListBoxCell                *cell);
+void        p_list_box_set_tile_limit               (PListBox                    *self,
+						       guint                          limit);
+void        p_list_box_set_cell_sort_func           (PListBox                    *self,
+						       PListBoxCellSortFunc         f,
+						       void                          *f_target,
+						       GDestroyNotify                 f_target_destroy_notify);
+PListBoxCell * p_list_box_get_selected_cell         (PListBox                    *self);
+void        p_list_box_set_header_func              (PListBox                    *self,
+						       PListBoxCreateHeaderFunc     create_header,
+						       void                          *create_header_target,
+						       GDestroyNotify                 create_header_target_destroy_notify);
+void        p_list_box_set_child_section            (PListBox                    *self,
+						       GtkWidget                     *child,
+						       const gchar                   *section);
+void        p_list_box_cell_set_section             (PListBox                    *self,
+						       PListBoxCell                *cell,
+						       const gchar                   *section);
+void        p_list_box_set_search_key_func          (PListBox                    *self,
+						       PListBoxSearchKeyFunc        f,
+						       void                          *f_target,
+						       GDestroyNotify                 f_target_destroy_notify);
+void        p_list_box_set_columns                  (PListBox                    *self,
+						       guint                          n_columns,
+						       PListBoxUpdateColumnsFunc    update_columns,
+						       void                          *update_columns_target,
+						       GDestroyNotify                 update_columns_target_destroy_notify);
+void        p_list_box_set_child_column_widths      (PListBox                    *self,
+						       GtkWidget                     *child,
+						       const gint                    *widths);
+void        p_list_box_cell_set_column_widths       (PListBox                    *self,
+						       PListBoxCell                *cell,
+						       const gint                    *widths);
+gint        p_list_box_get_column_width             (PListBox                    *self,
+						       guint                          column);
+void        p_list_box_set_load_children_func       (PListBox                    *self,
+						       PListBoxLoadChildrenFunc     f,
+						       void                          *f_target,
+						       GDestroyNotify                 f_target_destroy_notify);
+void        p_list_box_add_child_row                (PListBox                    *self,
+						       GtkWidget                     *parent,
+						       GtkWidget                     *child);
+void        p_list_box_expand_child                 (PListBox                    *self,
+						       GtkWidget                     *child);
+void        p_list_box_collapse_child               (PListBox                    *self,
+						       GtkWidget                     *child);
+gboolean    p_list_box_get_child_expanded           (PListBox                    *self,
+						       GtkWidget                     *child);
+guint       p_list_box_get_child_depth              (PListBox                    *self,
+						       GtkWidget                     *child);
+void        p_list_box_set_layout_mode              (PListBox                    *self,
+						       PListBoxLayoutMode           mode);
+PListBoxLayoutMode p_list_box_get_layout_mode       (PListBox                    *self);
+void        p_list_box_set_grid_item_size           (PListBox                    *self,
+						       gint                           width,
+						       gint                           height);
+void        p_list_box_set_row_animation_duration   (PListBox                    *self,
+						       guint                          duration);
+guint       p_list_box_render_pages                 (PListBox                    *self,
+						       cairo_t                       *cr,
+						       gint                           width,
+						       gint                           page_height,
+						       PListBoxPageFunc             page_done,
+						       void                          *page_done_target);
 void        p_list_box_set_activate_on_single_click (PListBox                    *self,
 						       gboolean                       single);
 void        p_list_box_drag_unhighlight_widget      (PListBox                    *self);
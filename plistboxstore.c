@@ -0,0 +1,686 @@
+/*
+ * Copyright (C) 2026 The pstack authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+
+#include "plistboxstore.h"
+
+/* A store owns the items shown by any number of PListBox views, along
+   with the keys they are sorted by, which are computed once per change
+   for all views. A view is a list box showing a cell for each item
+   that passes its filter, ordered by one of the keys. When an item
+   changes each view only moves, adds or drops that one cell. */
+
+typedef struct _PListBoxStoreKey PListBoxStoreKey;
+typedef struct _PListBoxStoreView PListBoxStoreView;
+
+struct _PListBoxStorePrivate
+{
+  GSequence *items;
+  GDestroyNotify data_destroy_notify;
+  guint serial;
+
+  GPtrArray *keys;
+
+  /* Views by slot, NULL where a view went away. Every item has a cell
+     pointer per slot. */
+  GPtrArray *views;
+};
+
+/* Held by the store and by each cell showing it, as a worker thread
+   of a view may still render a removed cell */
+struct _PListBoxStoreItem
+{
+  guint ref_count;
+  gpointer data;
+  GDestroyNotify data_destroy_notify;
+  guint serial;
+  GSequenceIter *iter;
+  gchar **keys;
+  guint n_keys;
+  PListBoxCell **cells;
+};
+
+struct _PListBoxStoreKey
+{
+  PListBoxStoreKeyFunc func;
+  gpointer func_target;
+  GDestroyNotify func_target_destroy_notify;
+};
+
+struct _PListBoxStoreView
+{
+  PListBoxStore *store;
+  PListBox *list_box;
+  guint slot;
+  gint sort_key;
+  gboolean descending;
+  PListBoxStoreFilterFunc filter_func;
+  gpointer filter_func_target;
+  GDestroyNotify filter_func_target_destroy_notify;
+};
+
+G_DEFINE_TYPE (PListBoxStore, p_list_box_store, G_TYPE_OBJECT)
+
+static void
+p_list_box_store_key_free (PListBoxStoreKey *key)
+{
+  if (key->func_target_destroy_notify != NULL)
+    key->func_target_destroy_notify (key->func_target);
+  g_slice_free (PListBoxStoreKey, key);
+}
+
+static PListBoxStoreItem *
+p_list_box_store_item_ref (PListBoxStoreItem *item)
+{
+  item->ref_count++;
+  return item;
+}
+
+/* Also the cell data destroy notify of the views */
+static void
+p_list_box_store_item_unref (PListBoxStoreItem *item)
+{
+  guint i;
+
+  if (--item->ref_count > 0)
+    return;
+
+  for (i = 0; i < item->n_keys; i++)
+    g_free (item->keys[i]);
+  g_free (item->keys);
+  g_free (item->cells);
+  if (item->data_destroy_notify != NULL)
+    item->data_destroy_notify (item->data);
+  g_slice_free (PListBoxStoreItem, item);
+}
+
+static gchar *
+p_list_box_store_compute_key (PListBoxStore *store,
+			       PListBoxStoreItem *item,
+			       guint key)
+{
+  PListBoxStoreKey *k = g_ptr_array_index (store->priv->keys, key);
+
+  return k->func (item->data, k->func_target);
+}
+
+static void
+p_list_box_store_update_keys (PListBoxStore *store,
+			       PListBoxStoreItem *item)
+{
+  PListBoxStorePrivate *priv = store->priv;
+  guint i;
+
+  for (i = 0; i < priv->keys->len; i++)
+    {
+      g_free (item->keys[i]);
+      item->keys[i] = p_list_box_store_compute_key (store, item, i);
+    }
+}
+
+/* Store order breaks ties, so the order in a view is total */
+static gint
+p_list_box_store_view_compare (PListBoxStoreItem *a,
+				PListBoxStoreItem *b,
+				PListBoxStoreView *view)
+{
+  gint cmp = 0;
+
+  if (view->sort_key >= 0)
+    cmp = g_strcmp0 (a->keys[view->sort_key], b->keys[view->sort_key]);
+  if (cmp == 0)
+    cmp = a->serial < b->serial ? -1 : a->serial > b->serial;
+
+  return view->descending ? -cmp : cmp;
+}
+
+/* Brings item's cell in view up to date. Unless the item itself
+   changed, a cell that stays needs no update. */
+static void
+p_list_box_store_view_update (PListBoxStoreView *view,
+			       PListBoxStoreItem *item,
+			       gboolean changed)
+{
+  PListBoxCell **cell = &item->cells[view->slot];
+  gboolean shown;
+
+  shown = view->filter_func == NULL ||
+    view->filter_func (item, view->filter_func_target);
+
+  if (shown && *cell == NULL)
+    *cell = p_list_box_add_cell (view->list_box, p_list_box_store_item_ref (item));
+  else if (shown && changed)
+    p_list_box_cell_changed (view->list_box, *cell);
+  else if (!shown && *cell != NULL)
+    {
+      p_list_box_remove_cell (view->list_box, *cell);
+      *cell = NULL;
+    }
+}
+
+static void
+p_list_box_store_view_free (PListBoxStoreView *view)
+{
+  if (view->filter_func_target_destroy_notify != NULL)
+    view->filter_func_target_destroy_notify (view->filter_func_target);
+  g_slice_free (PListBoxStoreView, view);
+}
+
+static void
+p_list_box_store_forget_view (PListBoxStoreView *view)
+{
+  PListBoxStorePrivate *priv = view->store->priv;
+  PListBoxStoreItem *item;
+  GSequenceIter *iter;
+
+  for (iter = g_sequence_get_begin_iter (priv->items);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      item = g_sequence_get (iter);
+      item->cells[view->slot] = NULL;
+    }
+
+  g_ptr_array_index (priv->views, view->slot) = NULL;
+  p_list_box_store_view_free (view);
+}
+
+/* The list box is going away along with its cells */
+static void
+p_list_box_store_view_weak_notify (gpointer data,
+				    GObject *where_the_object_was)
+{
+  p_list_box_store_forget_view (data);
+}
+
+static PListBoxStoreView *
+p_list_box_store_lookup_view (PListBoxStore *store,
+			       PListBox *list_box)
+{
+  PListBoxStorePrivate *priv = store->priv;
+  PListBoxStoreView *view;
+  guint i;
+
+  for (i = 0; i < priv->views->len; i++)
+    {
+      view = g_ptr_array_index (priv->views, i);
+      if (view != NULL && view->list_box == list_box)
+	return view;
+    }
+
+  return NULL;
+}
+
+static void
+p_list_box_store_remove_view (PListBoxStoreView *view)
+{
+  PListBoxStorePrivate *priv = view->store->priv;
+  PListBoxStoreItem *item;
+  GSequenceIter *iter;
+  PListBox *list_box = view->list_box;
+
+  g_object_weak_unref (G_OBJECT (list_box), p_list_box_store_view_weak_notify, view);
+  for (iter = g_sequence_get_begin_iter (priv->items);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      item = g_sequence_get (iter);
+      if (item->cells[view->slot] != NULL)
+	p_list_box_remove_cell (list_box, item->cells[view->slot]);
+    }
+  p_list_box_store_forget_view (view);
+  p_list_box_set_cell_sort_func (list_box, NULL, NULL, NULL);
+  p_list_box_set_cell_data_destroy_notify (list_box, NULL);
+}
+
+static void
+p_list_box_store_init (PListBoxStore *store)
+{
+  PListBoxStorePrivate *priv;
+
+  store->priv = priv =
+    G_TYPE_INSTANCE_GET_PRIVATE (store, P_TYPE_LIST_BOX_STORE, PListBoxStorePrivate);
+
+  priv->items = g_sequence_new (NULL);
+  priv->keys = g_ptr_array_new_with_free_func ((GDestroyNotify) p_list_box_store_key_free);
+  priv->views = g_ptr_array_new ();
+}
+
+static void
+p_list_box_store_dispose (GObject *obj)
+{
+  PListBoxStore *store = P_LIST_BOX_STORE (obj);
+  PListBoxStorePrivate *priv = store->priv;
+  PListBoxStoreView *view;
+  guint i;
+
+  /* The views' cells point at our items */
+  for (i = 0; i < priv->views->len; i++)
+    {
+      view = g_ptr_array_index (priv->views, i);
+      if (view != NULL)
+	p_list_box_store_remove_view (view);
+    }
+
+  G_OBJECT_CLASS (p_list_box_store_parent_class)->dispose (obj);
+}
+
+static void
+p_list_box_store_finalize (GObject *obj)
+{
+  PListBoxStore *store = P_LIST_BOX_STORE (obj);
+  PListBoxStorePrivate *priv = store->priv;
+  GSequenceIter *iter;
+
+  for (iter = g_sequence_get_begin_iter (priv->items);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    p_list_box_store_item_unref (g_sequence_get (iter));
+  g_sequence_free (priv->items);
+  g_ptr_array_unref (priv->keys);
+  g_ptr_array_unref (priv->views);
+
+  G_OBJECT_CLASS (p_list_box_store_parent_class)->finalize (obj);
+}
+
+static void
+p_list_box_store_class_init (PListBoxStoreClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (PListBoxStorePrivate));
+
+  object_class->dispose = p_list_box_store_dispose;
+  object_class->finalize = p_list_box_store_finalize;
+}
+
+/**
+ * p_list_box_store_new:
+ * @data_destroy_notify: Frees the data of the items.
+ *
+ * Creates an empty store.
+ *
+ * Return value: (transfer full): A new #PListBoxStore.
+ **/
+PListBoxStore *
+p_list_box_store_new (GDestroyNotify data_destroy_notify)
+{
+  PListBoxStore *store;
+
+  store = g_object_new (P_TYPE_LIST_BOX_STORE, NULL);
+  store->priv->data_destroy_notify = data_destroy_notify;
+
+  return store;
+}
+
+/**
+ * p_list_box_store_add_key:
+ * @self: An #PListBoxStore.
+ * @f: Computes the key of an item's data.
+ * @f_target: Data for @f.
+ * @f_target_destroy_notify: Frees @f_target.
+ *
+ * Adds a key that views can be sorted by. Keys are compared with
+ * strcmp(), so text should go through g_utf8_collate_key() first. @f
+ * is called once for each item and again when it changed, never per
+ * view.
+ *
+ * Return value: The number of the key.
+ **/
+guint
+p_list_box_store_add_key (PListBoxStore *store,
+			   PListBoxStoreKeyFunc f,
+			   void *f_target,
+			   GDestroyNotify f_target_destroy_notify)
+{
+  PListBoxStorePrivate *priv = store->priv;
+  PListBoxStoreKey *key;
+  PListBoxStoreItem *item;
+  GSequenceIter *iter;
+  guint n;
+
+  g_return_val_if_fail (store != NULL, 0);
+  g_return_val_if_fail (f != NULL, 0);
+
+  key = g_slice_new0 (PListBoxStoreKey);
+  key->func = f;
+  key->func_target = f_target;
+  key->func_target_destroy_notify = f_target_destroy_notify;
+  n = priv->keys->len;
+  g_ptr_array_add (priv->keys, key);
+
+  for (iter = g_sequence_get_begin_iter (priv->items);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      item = g_sequence_get (iter);
+      item->keys = g_renew (gchar *, item->keys, n + 1);
+      item->keys[n] = p_list_box_store_compute_key (store, item, n);
+      item->n_keys = n + 1;
+    }
+
+  return n;
+}
+
+/**
+ * p_list_box_store_append:
+ * @self: An #PListBoxStore.
+ * @data: The data of the new item.
+ *
+ * Adds an item, and shows it in every view whose filter it passes.
+ *
+ * Return value: (transfer none): The new item.
+ **/
+PListBoxStoreItem *
+p_list_box_store_append (PListBoxStore *store,
+			  gpointer data)
+{
+  PListBoxStorePrivate *priv = store->priv;
+  PListBoxStoreItem *item;
+  PListBoxStoreView *view;
+  guint i;
+
+  g_return_val_if_fail (store != NULL, NULL);
+
+  item = g_slice_new0 (PListBoxStoreItem);
+  item->ref_count = 1;
+  item->data = data;
+  item->data_destroy_notify = priv->data_destroy_notify;
+  item->serial = priv->serial++;
+  item->keys = g_new0 (gchar *, priv->keys->len);
+  item->n_keys = priv->keys->len;
+  item->cells = g_new0 (PListBoxCell *, priv->views->len);
+  p_list_box_store_update_keys (store, item);
+  item->iter = g_sequence_append (priv->items, item);
+
+  for (i = 0; i < priv->views->len; i++)
+    {
+      view = g_ptr_array_index (priv->views, i);
+      if (view != NULL)
+	p_list_box_store_view_update (view, item, TRUE);
+    }
+
+  return item;
+}
+
+/**
+ * p_list_box_store_remove:
+ * @self: An #PListBoxStore.
+ * @item: The item to remove.
+ *
+ * Removes an item from the store and all views.
+ **/
+void
+p_list_box_store_remove (PListBoxStore *store,
+			  PListBoxStoreItem *item)
+{
+  PListBoxStorePrivate *priv = store->priv;
+  PListBoxStoreView *view;
+  guint i;
+
+  g_return_if_fail (store != NULL);
+  g_return_if_fail (item != NULL);
+
+  for (i = 0; i < priv->views->len; i++)
+    {
+      view = g_ptr_array_index (priv->views, i);
+      if (view != NULL && item->cells[i] != NULL)
+	p_list_box_remove_cell (view->list_box, item->cells[i]);
+    }
+
+  g_sequence_remove (item->iter);
+  p_list_box_store_item_unref (item);
+}
+
+/**
+ * p_list_box_store_item_changed:
+ * @self: An #PListBoxStore.
+ * @item: The item that changed.
+ *
+ * Computes the keys of @item again and updates every view, which
+ * filters the item again and moves, adds or drops its row.
+ **/
+void
+p_list_box_store_item_changed (PListBoxStore *store,
+				PListBoxStoreItem *item)
+{
+  PListBoxStorePrivate *priv = store->priv;
+  PListBoxStoreView *view;
+  guint i;
+
+  g_return_if_fail (store != NULL);
+  g_return_if_fail (item != NULL);
+
+  p_list_box_store_update_keys (store, item);
+
+  for (i = 0; i < priv->views->len; i++)
+    {
+      view = g_ptr_array_index (priv->views, i);
+      if (view != NULL)
+	p_list_box_store_view_update (view, item, TRUE);
+    }
+}
+
+/**
+ * p_list_box_store_get_n_items:
+ * @self: An #PListBoxStore.
+ *
+ * Gets the number of items in the store.
+ *
+ * Return value: The number of items.
+ **/
+guint
+p_list_box_store_get_n_items (PListBoxStore *store)
+{
+  g_return_val_if_fail (store != NULL, 0);
+
+  return g_sequence_get_length (store->priv->items);
+}
+
+/**
+ * p_list_box_store_item_get_data:
+ * @item: An item of a #PListBoxStore.
+ *
+ * Gets the data of an item. The cells of a view have the item as their
+ * data, so this is how they get at it.
+ *
+ * Return value: (transfer none): The data.
+ **/
+gpointer
+p_list_box_store_item_get_data (PListBoxStoreItem *item)
+{
+  g_return_val_if_fail (item != NULL, NULL);
+
+  return item->data;
+}
+
+/**
+ * p_list_box_store_item_get_key:
+ * @item: An item of a #PListBoxStore.
+ * @key: The number of a key.
+ *
+ * Gets the cached value of a key for an item, for instance to filter
+ * on it.
+ *
+ * Return value: (transfer none): The key.
+ **/
+const gchar *
+p_list_box_store_item_get_key (PListBoxStoreItem *item,
+				guint key)
+{
+  g_return_val_if_fail (item != NULL, NULL);
+
+  return item->keys[key];
+}
+
+/**
+ * p_list_box_store_attach:
+ * @self: An #PListBoxStore.
+ * @list_box: The list box to show the items in.
+ * @filter: (allow-none): Whether to show an item.
+ * @filter_target: Data for @filter.
+ * @filter_target_destroy_notify: Frees @filter_target.
+ *
+ * Makes @list_box a view of the store. It gets a cell for each item
+ * that passes @filter, in store order until p_list_box_store_set_view_sort()
+ * is called. The cell data is the #PListBoxStoreItem, and the store
+ * sets the cell data destroy notify of @list_box, so cells should not
+ * be removed other than through the store. A removed item stays alive
+ * while a worker thread of @list_box still renders its cell.
+ **/
+void
+p_list_box_store_attach (PListBoxStore *store,
+			  PListBox *list_box,
+			  PListBoxStoreFilterFunc filter,
+			  void *filter_target,
+			  GDestroyNotify filter_target_destroy_notify)
+{
+  PListBoxStorePrivate *priv = store->priv;
+  PListBoxStoreView *view;
+  PListBoxStoreItem *item;
+  GSequenceIter *iter;
+  guint slot;
+
+  g_return_if_fail (store != NULL);
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (p_list_box_store_lookup_view (store, list_box) == NULL);
+
+  for (slot = 0; slot < priv->views->len; slot++)
+    if (g_ptr_array_index (priv->views, slot) == NULL)
+      break;
+
+  /* Every item needs room for a cell in the new slot */
+  if (slot == priv->views->len)
+    {
+      g_ptr_array_add (priv->views, NULL);
+      for (iter = g_sequence_get_begin_iter (priv->items);
+	   !g_sequence_iter_is_end (iter);
+	   iter = g_sequence_iter_next (iter))
+	{
+	  item = g_sequence_get (iter);
+	  item->cells = g_renew (PListBoxCell *, item->cells, priv->views->len);
+	  item->cells[slot] = NULL;
+	}
+    }
+
+  view = g_slice_new0 (PListBoxStoreView);
+  view->store = store;
+  view->list_box = list_box;
+  view->slot = slot;
+  view->sort_key = -1;
+  view->filter_func = filter;
+  view->filter_func_target = filter_target;
+  view->filter_func_target_destroy_notify = filter_target_destroy_notify;
+  g_ptr_array_index (priv->views, slot) = view;
+  g_object_weak_ref (G_OBJECT (list_box), p_list_box_store_view_weak_notify, view);
+
+  p_list_box_set_cell_data_destroy_notify (list_box,
+					   (GDestroyNotify) p_list_box_store_item_unref);
+  p_list_box_set_cell_sort_func (list_box,
+				 (PListBoxCellSortFunc) p_list_box_store_view_compare,
+				 view, NULL);
+  for (iter = g_sequence_get_begin_iter (priv->items);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    p_list_box_store_view_update (view, g_sequence_get (iter), FALSE);
+}
+
+/**
+ * p_list_box_store_detach:
+ * @self: An #PListBoxStore.
+ * @list_box: A view of the store.
+ *
+ * Removes the cells of the store from @list_box, which stops being a
+ * view of the store.
+ **/
+void
+p_list_box_store_detach (PListBoxStore *store,
+			  PListBox *list_box)
+{
+  PListBoxStoreView *view;
+
+  g_return_if_fail (store != NULL);
+  g_return_if_fail (list_box != NULL);
+
+  view = p_list_box_store_lookup_view (store, list_box);
+  g_return_if_fail (view != NULL);
+
+  p_list_box_store_remove_view (view);
+}
+
+/**
+ * p_list_box_store_set_view_sort:
+ * @self: An #PListBoxStore.
+ * @list_box: A view of the store.
+ * @key: The number of the key to sort by, or -1 for store order.
+ * @descending: Whether to sort the other way around.
+ *
+ * Sets how a view is sorted. Items with the same key stay in store
+ * order.
+ **/
+void
+p_list_box_store_set_view_sort (PListBoxStore *store,
+				 PListBox *list_box,
+				 gint key,
+				 gboolean descending)
+{
+  PListBoxStoreView *view;
+
+  g_return_if_fail (store != NULL);
+  g_return_if_fail (list_box != NULL);
+  g_return_if_fail (key < (gint) store->priv->keys->len);
+
+  view = p_list_box_store_lookup_view (store, list_box);
+  g_return_if_fail (view != NULL);
+
+  view->sort_key = key;
+  view->descending = descending != FALSE;
+  /* Sorts the cells again */
+  p_list_box_set_cell_sort_func (list_box,
+				 (PListBoxCellSortFunc) p_list_box_store_view_compare,
+				 view, NULL);
+}
+
+/**
+ * p_list_box_store_refilter:
+ * @self: An #PListBoxStore.
+ * @list_box: A view of the store.
+ *
+ * Runs the filter of a view over all items again, for when what it
+ * filters on changed.
+ **/
+void
+p_list_box_store_refilter (PListBoxStore *store,
+			    PListBox *list_box)
+{
+  PListBoxStoreView *view;
+  GSequenceIter *iter;
+
+  g_return_if_fail (store != NULL);
+  g_return_if_fail (list_box != NULL);
+
+  view = p_list_box_store_lookup_view (store, list_box);
+  g_return_if_fail (view != NULL);
+
+  for (iter = g_sequence_get_begin_iter (store->priv->items);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    p_list_box_store_view_update (view, g_sequence_get (iter), FALSE);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026 The pstack authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __P_LIST_BOX_STORE_H__
+#define __P_LIST_BOX_STORE_H__
+
+#include <glib.h>
+#include <glib-object.h>
+#include "plistbox.h"
+
+G_BEGIN_DECLS
+
+
+#define P_TYPE_LIST_BOX_STORE (p_list_box_store_get_type ())
+#define P_LIST_BOX_STORE(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), P_TYPE_LIST_BOX_STORE, PListBoxStore))
+#define P_LIST_BOX_STORE_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST ((klass), P_TYPE_LIST_BOX_STORE, PListBoxStoreClass))
+#define P_IS_LIST_BOX_STORE(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), P_TYPE_LIST_BOX_STORE))
+#define P_IS_LIST_BOX_STORE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), P_TYPE_LIST_BOX_STORE))
+#define P_LIST_BOX_STORE_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), P_TYPE_LIST_BOX_STORE, PListBoxStoreClass))
+
+typedef struct _PListBoxStore PListBoxStore;
+typedef struct _PListBoxStoreClass PListBoxStoreClass;
+typedef struct _PListBoxStorePrivate PListBoxStorePrivate;
+typedef struct _PListBoxStoreItem PListBoxStoreItem;
+
+struct _PListBoxStore
+{
+  GObject parent_instance;
+  PListBoxStorePrivate * priv;
+};
+
+struct _PListBoxStoreClass
+{
+  GObjectClass parent_class;
+};
+
+typedef gchar* (*PListBoxStoreKeyFunc) (gpointer data, void* user_data);
+typedef gboolean (*PListBoxStoreFilterFunc) (PListBoxStoreItem* item, void* user_data);
+
+GType p_list_box_store_get_type (void) G_GNUC_CONST;
+PListBoxStore * p_list_box_store_new                (GDestroyNotify                 data_destroy_notify);
+guint       p_list_box_store_add_key                (PListBoxStore               *self,
+						       PListBoxStoreKeyFunc         f,
+						       void                          *f_target,
+						       GDestroyNotify                 f_target_destroy_notify);
+PListBoxStoreItem * p_list_box_store_append         (PListBoxStore               *self,
+						       gpointer                       data);
+void        p_list_box_store_remove                 (PListBoxStore               *self,
+						       PListBoxStoreItem           *item);
+void        p_list_box_store_item_changed           (PListBoxStore               *self,
+						       PListBoxStoreItem           *item);
+guint       p_list_box_store_get_n_items            (PListBoxStore               *self);
+gpointer    p_list_box_store_item_get_data          (PListBoxStoreItem           *item);
+const gchar * p_list_box_store_item_get_key         (PListBoxStoreItem           *item,
+						       guint                          key);
+void        p_list_box_store_attach                 (PListBoxStore               *self,
+						       PListBox                    *list_box,
+						       PListBoxStoreFilterFunc      filter,
+						       void                          *filter_target,
+						       GDestroyNotify                 filter_target_destroy_notify);
+void        p_list_box_store_detach                 (PListBoxStore               *self,
+						       PListBox                    *list_box);
+void        p_list_box_store_set_view_sort          (PListBoxStore               *self,
+						       PListBox                    *list_box,
+						       gint                           key,
+						       gboolean                       descending);
+void        p_list_box_store_refilter               (PListBoxStore               *self,
+						       PListBox                    *list_box);
+
+G_END_DECLS
+
+#endif
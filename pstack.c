@@ -31,6 +31,10 @@
 #define GTK_PARAM_READWRITE G_PARAM_READWRITE|G_PARAM_STATIC_NAME|G_PARAM_STATIC_NICK|G_PARAM_STATIC_BLURB
 #define P_(String) (String)
 
+/* Pages drawing anew can only be told from GTK 3.10 on, before that
+   nothing is snapshotted beyond the transition it is taken for */
+#define HAVE_INVALIDATE_HANDLER GTK_CHECK_VERSION (3, 10, 0)
+
 GType
 p_stack_transition_type_get_type (void)
 {
@@ -105,17 +109,68 @@ enum
   CHILD_PROP_POSITION
 };
 
+enum
+{
+  PAGE_UNLOADED,
+  LAST_SIGNAL
+};
+
+/* Slots of the size cache of homogeneous stacks */
+enum
+{
+  SIZE_WIDTH,
+  SIZE_WIDTH_FOR_HEIGHT,
+  SIZE_HEIGHT,
+  SIZE_HEIGHT_FOR_WIDTH,
+  N_SIZE_SLOTS
+};
+
 typedef struct _PStackChildInfo PStackChildInfo;
+typedef struct _PStackLazyPage PStackLazyPage;
 
 struct _PStackChildInfo {
   GtkWidget *widget;
   gchar *name;
   gchar *title;
   gchar *icon_name;
+  GSequenceIter *iter;
+  /* Set if the page was built by a factory */
+  PStackLazyPage *lazy;
+  /* Was shown or prewarmed */
+  gboolean warm;
+  /* Drawn when the page was last left, link in priv->snapshots */
+  cairo_surface_t *snapshot;
+  GtkAllocation snapshot_allocation;
+  gsize snapshot_bytes;
+  GList *snapshot_link;
+  /* Sizes measured while hidden in a homogeneous stack, a bit per
+     valid slot */
+  guint size_cached;
+  gint size_for[N_SIZE_SLOTS];
+  gint size_min[N_SIZE_SLOTS];
+  gint size_nat[N_SIZE_SLOTS];
+};
+
+/* A page that is only built when it is first shown */
+struct _PStackLazyPage {
+  gchar *name;
+  gchar *title;
+  PStackPageFactory factory;
+  gpointer factory_target;
+  GDestroyNotify factory_target_destroy_notify;
+  /* The page while it is built */
+  PStackChildInfo *info;
+  /* Link in priv->unloadable while built and hidden */
+  GList *link;
+  gint64 hidden_time;
 };
 
 struct _PStackPrivate {
-  GList *children;
+  /* Pages in order, so positions and moves are logarithmic */
+  GSequence *children;
+  /* Name -> PStackChildInfo, the first page with that name */
+  GHashTable *names;
+  gboolean has_duplicate_names;
 
   GdkWindow* bin_window;
   GdkWindow* view_window;
@@ -130,12 +185,48 @@ struct _PStackPrivate {
   PStackChildInfo *last_visible_child;
   cairo_surface_t *last_visible_surface;
   GtkAllocation last_visible_surface_allocation;
+  /* The page in last_visible_surface, if it is a single page */
+  PStackChildInfo *last_visible_surface_child;
+  /* The incoming page of a crossfade, until it draws anew */
+  cairo_surface_t *visible_surface;
+  GtkAllocation visible_surface_allocation;
+  gboolean visible_surface_stale;
   gdouble transition_pos;
   guint tick_id;
   gint64 start_time;
   gint64 end_time;
 
   PStackTransitionType active_transition_type;
+
+  /* Name -> PStackLazyPage. Built pages that are hidden are in
+     unloadable, most recently hidden first. */
+  GHashTable *lazy_pages;
+  GQueue unloadable;
+  guint unload_timeout;
+  guint max_hidden_pages;
+  guint unload_timeout_id;
+
+  /* Pages waiting to be prewarmed, lazy pages by name */
+  GQueue prewarm_children;
+  GQueue prewarm_names;
+  guint prewarm_id;
+  gboolean prewarm_adjacent;
+
+  /* Page snapshots, most recently used first */
+  GQueue snapshots;
+  gsize snapshot_bytes;
+  gsize snapshot_cache_size;
+  /* Set while the stack maps, unmaps or redraws pages for a switch,
+     which does not make the snapshot of the visible page stale */
+  gboolean switching_pages;
+
+  /* Largest unconstrained sizes of the hidden pages, a bit per valid
+     slot, for the pages that were shown when they were taken */
+  guint hidden_size_cached;
+  PStackChildInfo *hidden_size_visible;
+  PStackChildInfo *hidden_size_last;
+  gint hidden_size_min[N_SIZE_SLOTS];
+  gint hidden_size_nat[N_SIZE_SLOTS];
 };
 
 static void     p_stack_add                            (GtkContainer  *widget,
@@ -191,13 +282,53 @@ static gint     get_bin_window_x                         (PStack      *stack,
                                                           GtkAllocation *allocation);
 static gint     get_bin_window_y                         (PStack      *stack,
                                                           GtkAllocation *allocation);
+static void     p_stack_page_shown                       (PStack      *stack,
+                                                          PStackChildInfo *info);
+static void     p_stack_page_hidden                      (PStack      *stack,
+                                                          PStackChildInfo *info);
+static PStackChildInfo *p_stack_load_lazy_page           (PStack      *stack,
+                                                          PStackLazyPage *lazy);
+static void     p_stack_lazy_page_free                   (PStackLazyPage *lazy);
+static void     p_stack_unload_pages                     (PStack      *stack);
+static void     p_stack_prewarm_adjacent                 (PStack      *stack);
+static void     p_stack_drop_snapshot                    (PStack      *stack,
+                                                          PStackChildInfo *info);
+static void     p_stack_drop_snapshots                   (PStack      *stack,
+                                                          gsize        limit);
+static void     p_stack_keep_snapshot                    (PStack      *stack,
+                                                          PStackChildInfo *info,
+                                                          cairo_surface_t *surface,
+                                                          GtkAllocation *allocation);
+static void     p_stack_draw_crossfade                   (GtkWidget   *widget,
+                                                          cairo_t     *cr);
+static void     p_stack_draw_slide                       (GtkWidget   *widget,
+                                                          cairo_t     *cr);
+#if HAVE_INVALIDATE_HANDLER
+static void     p_stack_bin_window_invalidated           (GdkWindow   *window,
+                                                          cairo_region_t *region);
+#endif
+static void     stack_child_size_allocate_cb             (GtkWidget   *child,
+                                                          GtkAllocation *allocation,
+                                                          gpointer     user_data);
 
 G_DEFINE_TYPE(PStack, p_stack, GTK_TYPE_CONTAINER);
 
+/* Pages point back at their child info with this */
+static GQuark child_info_quark;
+static guint signals[LAST_SIGNAL] = { 0 };
+
 static void
 p_stack_init (PStack *stack)
 {
-  stack->priv = G_TYPE_INSTANCE_GET_PRIVATE (stack, P_TYPE_STACK, PStackPrivate);
+  PStackPrivate *priv;
+
+  stack->priv = priv = G_TYPE_INSTANCE_GET_PRIVATE (stack, P_TYPE_STACK, PStackPrivate);
+  priv->children = g_sequence_new (NULL);
+  priv->names = g_hash_table_new (g_str_hash, g_str_equal);
+  priv->lazy_pages = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                            (GDestroyNotify) p_stack_lazy_page_free);
+  priv->max_hidden_pages = G_MAXUINT;
+  priv->snapshot_cache_size = 0;
 
   gtk_widget_set_has_window ((GtkWidget*) stack, TRUE);
   gtk_widget_set_redraw_on_allocate ((GtkWidget*) stack, TRUE);
@@ -213,6 +344,20 @@ p_stack_finalize (GObject *obj)
 
   if (priv->last_visible_surface != NULL)
     cairo_surface_destroy (priv->last_visible_surface);
+  if (priv->visible_surface != NULL)
+    cairo_surface_destroy (priv->visible_surface);
+
+  if (priv->unload_timeout_id != 0)
+    g_source_remove (priv->unload_timeout_id);
+  g_queue_clear (&priv->unloadable);
+  if (priv->prewarm_id != 0)
+    g_source_remove (priv->prewarm_id);
+  g_queue_clear (&priv->prewarm_children);
+  while (!g_queue_is_empty (&priv->prewarm_names))
+    g_free (g_queue_pop_head (&priv->prewarm_names));
+  g_hash_table_unref (priv->lazy_pages);
+  g_sequence_free (priv->children);
+  g_hash_table_unref (priv->names);
 
   G_OBJECT_CLASS (p_stack_parent_class)->finalize (obj);
 }
@@ -289,7 +434,7 @@ p_stack_realize (GtkWidget *widget)
   GdkWindowAttr attributes = { 0 };
   GdkWindowAttributesType attributes_mask;
   PStackChildInfo *info;
-  GList *l;
+  GSequenceIter *iter;
 
   gtk_widget_set_realized (widget, TRUE);
 
@@ -320,10 +465,15 @@ p_stack_realize (GtkWidget *widget)
   priv->bin_window =
     gdk_window_new (priv->view_window, &attributes, attributes_mask);
   gtk_widget_register_window (widget, priv->bin_window);
+#if HAVE_INVALIDATE_HANDLER
+  gdk_window_set_invalidate_handler (priv->bin_window, p_stack_bin_window_invalidated);
+#endif
 
-  for (l = priv->children; l != NULL; l = l->next)
+  for (iter = g_sequence_get_begin_iter (priv->children);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
     {
-      info = l->data;
+      info = g_sequence_get (iter);
 
       gtk_widget_set_parent_window (info->widget, priv->bin_window);
     }
@@ -337,6 +487,8 @@ p_stack_unrealize (GtkWidget *widget)
   PStack *stack = P_STACK (widget);
   PStackPrivate *priv = stack->priv;
 
+  /* Snapshots are made for the windows of this screen */
+  p_stack_drop_snapshots (stack, 0);
   gtk_widget_unregister_window (widget, priv->bin_window);
   gdk_window_destroy (priv->bin_window);
   priv->view_window = NULL;
@@ -439,7 +591,28 @@ p_stack_class_init (PStackClass *klass)
                       -1, G_MAXINT, 0,
                       GTK_PARAM_READWRITE));
 
+  /*
+   * PStack::page-unloaded:
+   * @stack: the #PStack
+   * @page: the page about to be destroyed
+   * @name: the name it was added with
+   *
+   * Emitted before a page built by a factory is destroyed to save
+   * memory, so its state can be kept for when it is built again.
+   */
+  signals[PAGE_UNLOADED] =
+    g_signal_new ("page-unloaded",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  g_cclosure_marshal_generic,
+                  G_TYPE_NONE, 2,
+                  GTK_TYPE_WIDGET, G_TYPE_STRING);
+
   g_type_class_add_private (klass, sizeof (PStackPrivate));
+
+  child_info_quark = g_quark_from_static_string ("p-stack-child-info");
 }
 
 /*
@@ -461,18 +634,85 @@ static PStackChildInfo *
 find_child_info_for_widget (PStack  *stack,
                             GtkWidget *child)
 {
-  PStackPrivate *priv = stack->priv;
   PStackChildInfo *info;
-  GList *l;
 
-  for (l = priv->children; l != NULL; l = l->next)
+  info = g_object_get_qdata (G_OBJECT (child), child_info_quark);
+  if (info == NULL || gtk_widget_get_parent (child) != GTK_WIDGET (stack))
+    return NULL;
+
+  return info;
+}
+
+static void
+set_page_child_visible (PStack  *stack,
+                        GtkWidget *child,
+                        gboolean   visible)
+{
+  stack->priv->switching_pages = TRUE;
+  gtk_widget_set_child_visible (child, visible);
+  stack->priv->switching_pages = FALSE;
+}
+
+static PStackChildInfo *
+find_child_info_for_name (PStack    *stack,
+                          const gchar *name)
+{
+  return g_hash_table_lookup (stack->priv->names, name);
+}
+
+/* Puts info in the name index, unless an earlier page has its name */
+static void
+index_child_name (PStack        *stack,
+                  PStackChildInfo *info)
+{
+  PStackPrivate *priv = stack->priv;
+  PStackChildInfo *other;
+
+  if (info->name == NULL)
+    return;
+
+  other = g_hash_table_lookup (priv->names, info->name);
+  if (other == NULL)
     {
-      info = l->data;
-      if (info->widget == child)
-        return info;
+      g_hash_table_replace (priv->names, info->name, info);
+      return;
     }
 
-  return NULL;
+  g_warning ("Duplicate child name in PStack: %s\n", info->name);
+  priv->has_duplicate_names = TRUE;
+  if (g_sequence_iter_compare (info->iter, other->iter) < 0)
+    g_hash_table_replace (priv->names, info->name, info);
+}
+
+/* Takes info out of the name index, another page with the same name
+   takes its place */
+static void
+unindex_child_name (PStack        *stack,
+                    PStackChildInfo *info)
+{
+  PStackPrivate *priv = stack->priv;
+  PStackChildInfo *other;
+  GSequenceIter *iter;
+
+  if (info->name == NULL ||
+      g_hash_table_lookup (priv->names, info->name) != info)
+    return;
+
+  g_hash_table_remove (priv->names, info->name);
+  if (!priv->has_duplicate_names)
+    return;
+
+  for (iter = g_sequence_get_begin_iter (priv->children);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      other = g_sequence_get (iter);
+      if (other != info && g_strcmp0 (other->name, info->name) == 0)
+        {
+          g_hash_table_replace (priv->names, other->name, other);
+          break;
+        }
+    }
 }
 
 static void
@@ -481,51 +721,43 @@ reorder_child (PStack  *stack,
                gint       position)
 {
   PStackPrivate *priv;
-  GList *l;
-  GList *old_link = NULL;
-  GList *new_link = NULL;
-  PStackChildInfo *child_info = NULL;
-  gint num = 0;
+  PStackChildInfo *child_info, *info;
+  GSequenceIter *new_iter, *iter;
 
   priv = stack->priv;
 
-  l = priv->children;
+  child_info = find_child_info_for_widget (stack, child);
+  g_return_if_fail (child_info != NULL);
 
-  /* Loop to find the old position and link of child, new link of child and
-   * total number of children. new_link will be NULL if the child should be
-   * moved to the end (in case of position being < 0 || >= num)
-   */
-  while (l && (new_link == NULL || old_link == NULL))
-    {
-      /* Record the new position if found */
-      if (position == num)
-        new_link = l;
+  /* The end if position is < 0 or >= the number of children */
+  if (position < 0 || position >= g_sequence_get_length (priv->children))
+    new_iter = g_sequence_get_end_iter (priv->children);
+  else
+    new_iter = g_sequence_get_iter_at_pos (priv->children, position);
 
-      if (old_link == NULL)
-        {
-          PStackChildInfo *info;
-          info = l->data;
+  if (new_iter == child_info->iter ||
+      (g_sequence_iter_next (child_info->iter) == new_iter &&
+       g_sequence_iter_is_end (new_iter)))
+    return;
 
-          /* Keep trying to find the current position and link location of the child */
-          if (info->widget == child)
+  g_sequence_move (child_info->iter, new_iter);
+
+  /* The first of several pages with a name may have changed */
+  if (priv->has_duplicate_names && child_info->name != NULL)
+    {
+      for (iter = g_sequence_get_begin_iter (priv->children);
+           !g_sequence_iter_is_end (iter);
+           iter = g_sequence_iter_next (iter))
+        {
+          info = g_sequence_get (iter);
+          if (g_strcmp0 (info->name, child_info->name) == 0)
             {
-              old_link = l;
-              child_info = info;
+              g_hash_table_replace (priv->names, info->name, info);
+              break;
             }
         }
-
-      l = g_list_next (l);
-      num++;
     }
 
-  g_return_if_fail (old_link != NULL);
-
-  if (old_link == new_link || (g_list_next (old_link) == NULL && new_link == NULL))
-    return;
-
-  priv->children = g_list_delete_link (priv->children, old_link);
-  priv->children = g_list_insert_before (priv->children, new_link, child_info);
-
   gtk_widget_child_notify (child, "position");
 }
 
@@ -538,8 +770,6 @@ p_stack_get_child_property (GtkContainer *container,
 {
   PStack *stack = P_STACK (container);
   PStackChildInfo *info;
-  GList *list;
-  guint i;
 
   info = find_child_info_for_widget (stack, child);
   if (info == NULL)
@@ -563,14 +793,7 @@ p_stack_get_child_property (GtkContainer *container,
       break;
 
     case CHILD_PROP_POSITION:
-      i = 0;
-      for (list = stack->priv->children; list != NULL; list = g_list_next (list))
-        {
-          if (info == list->data)
-            break;
-          ++i;
-        }
-      g_value_set_int (value, i);
+      g_value_set_int (value, g_sequence_iter_get_position (info->iter));
       break;
 
     default:
@@ -589,9 +812,6 @@ p_stack_set_child_property (GtkContainer *container,
   PStack *stack = P_STACK (container);
   PStackPrivate *priv = stack->priv;
   PStackChildInfo *info;
-  PStackChildInfo *info2;
-  gchar *name;
-  GList *l;
 
   info = find_child_info_for_widget (stack, child);
   if (info == NULL)
@@ -603,19 +823,10 @@ p_stack_set_child_property (GtkContainer *container,
   switch (property_id)
     {
     case CHILD_PROP_NAME:
-      name = g_value_dup_string (value);
-      for (l = priv->children; l != NULL; l = l->next)
-        {
-          info2 = l->data;
-          if (g_strcmp0 (info2->name, name) == 0)
-            {
-              g_warning ("Duplicate child name in PStack: %s\n", name);
-              break;
-            }
-        }
-
+      unindex_child_name (stack, info);
       g_free (info->name);
-      info->name = name;
+      info->name = g_value_dup_string (value);
+      index_child_name (stack, info);
 
       gtk_container_child_notify (container, child, "name");
 
@@ -692,6 +903,16 @@ get_bin_window_y (PStack      *stack,
   return y;
 }
 
+static void
+p_stack_clear_visible_surface (PStack *stack)
+{
+  PStackPrivate *priv = stack->priv;
+
+  if (priv->visible_surface != NULL)
+    cairo_surface_destroy (priv->visible_surface);
+  priv->visible_surface = NULL;
+}
+
 static gboolean
 p_stack_set_transition_position (PStack *stack,
                                    gdouble   pos)
@@ -700,7 +921,9 @@ p_stack_set_transition_position (PStack *stack,
   gboolean done;
 
   priv->transition_pos = pos;
+  priv->switching_pages = TRUE;
   gtk_widget_queue_draw (GTK_WIDGET (stack));
+  priv->switching_pages = FALSE;
 
   if (priv->bin_window != NULL &&
       (priv->active_transition_type == P_STACK_TRANSITION_TYPE_SLIDE_LEFT ||
@@ -720,8 +943,11 @@ p_stack_set_transition_position (PStack *stack,
     {
       if (priv->last_visible_child)
         {
-          gtk_widget_set_child_visible (priv->last_visible_child->widget, FALSE);
+          set_page_child_visible (stack, priv->last_visible_child->widget, FALSE);
           priv->last_visible_child = NULL;
+          /* The page that went out was skipped by the last pass */
+          if (priv->unloadable.length > 0)
+            p_stack_unload_pages (stack);
         }
     }
 
@@ -732,8 +958,11 @@ p_stack_set_transition_position (PStack *stack,
           cairo_surface_destroy (priv->last_visible_surface);
           priv->last_visible_surface = NULL;
         }
+      p_stack_clear_visible_surface (stack);
 
+      priv->switching_pages = TRUE;
       gtk_widget_queue_resize (GTK_WIDGET (stack));
+      priv->switching_pages = FALSE;
     }
 
   return done;
@@ -760,7 +989,9 @@ p_stack_transition_cb (PStack      *stack,
 
   if (p_stack_set_transition_position (stack, t))
     {
+      priv->switching_pages = TRUE;
       gtk_widget_set_opacity (GTK_WIDGET (stack), 1.0);
+      priv->switching_pages = FALSE;
       priv->tick_id = 0;
 
       return FALSE;
@@ -827,7 +1058,9 @@ p_stack_start_transition (PStack               *stack,
       transition_duration != 0 &&
       priv->last_visible_child != NULL)
     {
+      priv->switching_pages = TRUE;
       gtk_widget_set_opacity (widget, 0.999);
+      priv->switching_pages = FALSE;
 
       priv->transition_pos = 0.0;
       priv->start_time = gdk_frame_clock_get_frame_time (gtk_widget_get_frame_clock (widget));
@@ -843,6 +1076,146 @@ p_stack_start_transition (PStack               *stack,
     }
 }
 
+static PStackTransitionType
+reverse_transition_type (PStackTransitionType transition_type)
+{
+  switch (transition_type)
+    {
+    case P_STACK_TRANSITION_TYPE_SLIDE_LEFT:
+      return P_STACK_TRANSITION_TYPE_SLIDE_RIGHT;
+    case P_STACK_TRANSITION_TYPE_SLIDE_RIGHT:
+      return P_STACK_TRANSITION_TYPE_SLIDE_LEFT;
+    case P_STACK_TRANSITION_TYPE_SLIDE_UP:
+      return P_STACK_TRANSITION_TYPE_SLIDE_DOWN;
+    case P_STACK_TRANSITION_TYPE_SLIDE_DOWN:
+      return P_STACK_TRANSITION_TYPE_SLIDE_UP;
+    default:
+      return transition_type;
+    }
+}
+
+/* Turns a running transition towards child_info instead of starting
+   over from a snapshot of what is half way through. Going back to the
+   page being left reverses the transition from where it is, along the
+   same curve. Any other page comes in over what is shown now, which is
+   put together from the snapshots the transition already has, so only
+   the visible page may need to be drawn. */
+static gboolean
+p_stack_retarget_transition (PStack               *stack,
+                             PStackChildInfo      *child_info,
+                             PStackTransitionType  transition_type,
+                             guint                 transition_duration)
+{
+  PStackPrivate *priv = stack->priv;
+  GtkWidget *widget = GTK_WIDGET (stack);
+  GtkAllocation allocation;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  gboolean crossfade;
+  gdouble pos;
+  gint64 now;
+
+  if (priv->tick_id == 0 ||
+      priv->last_visible_surface == NULL ||
+      priv->visible_child == NULL ||
+      child_info == NULL ||
+      transition_type == P_STACK_TRANSITION_TYPE_NONE ||
+      transition_duration == 0 ||
+      !gtk_widget_get_mapped (widget))
+    return FALSE;
+
+  crossfade = priv->active_transition_type == P_STACK_TRANSITION_TYPE_CROSSFADE;
+
+  if (child_info == priv->last_visible_surface_child)
+    {
+      /* The page coming back is still in last_visible_surface, the
+         one being left takes its place */
+      if (priv->visible_surface != NULL)
+        {
+          surface = cairo_surface_reference (priv->visible_surface);
+          allocation = priv->visible_surface_allocation;
+        }
+      else
+        {
+          gtk_widget_get_allocation (priv->visible_child->widget, &allocation);
+          surface =
+            gdk_window_create_similar_surface (gtk_widget_get_window (widget),
+                                               CAIRO_CONTENT_COLOR_ALPHA,
+                                               allocation.width,
+                                               allocation.height);
+          cr = cairo_create (surface);
+          gtk_widget_draw (priv->visible_child->widget, cr);
+          cairo_destroy (cr);
+        }
+
+      p_stack_clear_visible_surface (stack);
+      priv->visible_surface_stale = !HAVE_INVALIDATE_HANDLER;
+      if (crossfade)
+        {
+          priv->visible_surface = priv->last_visible_surface;
+          priv->visible_surface_allocation = priv->last_visible_surface_allocation;
+        }
+      else
+        cairo_surface_destroy (priv->last_visible_surface);
+
+      priv->last_visible_surface = surface;
+      priv->last_visible_surface_allocation = allocation;
+      priv->last_visible_surface_child = priv->visible_child;
+
+      /* Keep both pages where they are: the fade weights swap, and a
+         slide runs back from the offset the eased position gave */
+      if (crossfade)
+        pos = 1.0 - priv->transition_pos;
+      else
+        pos = 1.0 - cbrt (ease_out_cubic (priv->transition_pos));
+      priv->active_transition_type = reverse_transition_type (priv->active_transition_type);
+    }
+  else
+    {
+      gtk_widget_get_allocation (widget, &allocation);
+      allocation.x = 0;
+      allocation.y = 0;
+      surface =
+        gdk_window_create_similar_surface (gtk_widget_get_window (widget),
+                                           CAIRO_CONTENT_COLOR_ALPHA,
+                                           allocation.width,
+                                           allocation.height);
+      cr = cairo_create (surface);
+      if (crossfade)
+        p_stack_draw_crossfade (widget, cr);
+      else
+        p_stack_draw_slide (widget, cr);
+      cairo_destroy (cr);
+
+      if (priv->visible_surface != NULL)
+        p_stack_keep_snapshot (stack, priv->visible_child,
+                               priv->visible_surface,
+                               &priv->visible_surface_allocation);
+      p_stack_clear_visible_surface (stack);
+      priv->visible_surface_stale = !HAVE_INVALIDATE_HANDLER;
+
+      cairo_surface_destroy (priv->last_visible_surface);
+      priv->last_visible_surface = surface;
+      priv->last_visible_surface_allocation = allocation;
+      priv->last_visible_surface_child = NULL;
+
+      pos = 0.0;
+      priv->active_transition_type = effective_transition_type (stack, transition_type);
+    }
+
+  if (priv->last_visible_child != NULL)
+    set_page_child_visible (stack, priv->last_visible_child->widget, FALSE);
+  priv->last_visible_child = NULL;
+  set_page_child_visible (stack, priv->visible_child->widget, FALSE);
+
+  now = gdk_frame_clock_get_frame_time (gtk_widget_get_frame_clock (widget));
+  priv->start_time = now - pos * transition_duration * 1000;
+  priv->end_time = priv->start_time + (transition_duration * 1000);
+  p_stack_set_transition_position (stack, pos);
+
+  return TRUE;
+}
+
 static void
 set_visible_child (PStack               *stack,
                    PStackChildInfo      *child_info,
@@ -850,16 +1223,19 @@ set_visible_child (PStack               *stack,
                    guint                   transition_duration)
 {
   PStackPrivate *priv = stack->priv;
-  PStackChildInfo *info;
+  PStackChildInfo *info, *old_info;
   GtkWidget *widget = GTK_WIDGET (stack);
-  GList *l;
+  GSequenceIter *iter;
+  gboolean retargeted;
 
   /* If none, pick first visible */
   if (child_info == NULL)
     {
-      for (l = priv->children; l != NULL; l = l->next)
+      for (iter = g_sequence_get_begin_iter (priv->children);
+           !g_sequence_iter_is_end (iter);
+           iter = g_sequence_iter_next (iter))
         {
-          info = l->data;
+          info = g_sequence_get (iter);
           if (gtk_widget_get_visible (info->widget))
             {
               child_info = info;
@@ -871,34 +1247,51 @@ set_visible_child (PStack               *stack,
   if (child_info == priv->visible_child)
     return;
 
-  if (priv->last_visible_child)
-    gtk_widget_set_child_visible (priv->last_visible_child->widget, FALSE);
-  priv->last_visible_child = NULL;
+  retargeted = p_stack_retarget_transition (stack, child_info,
+                                            transition_type,
+                                            transition_duration);
+  if (!retargeted)
+    {
+      if (priv->last_visible_child)
+        set_page_child_visible (stack, priv->last_visible_child->widget, FALSE);
+      priv->last_visible_child = NULL;
 
-  if (priv->last_visible_surface != NULL)
-    cairo_surface_destroy (priv->last_visible_surface);
-  priv->last_visible_surface = NULL;
+      if (priv->last_visible_surface != NULL)
+        cairo_surface_destroy (priv->last_visible_surface);
+      priv->last_visible_surface = NULL;
+      p_stack_clear_visible_surface (stack);
+      priv->visible_surface_stale = !HAVE_INVALIDATE_HANDLER;
 
-  if (priv->visible_child && priv->visible_child->widget)
-    {
-      if (gtk_widget_is_visible (widget))
-        priv->last_visible_child = priv->visible_child;
-      else
-        gtk_widget_set_child_visible (priv->visible_child->widget, FALSE);
+      if (priv->visible_child && priv->visible_child->widget)
+        {
+          if (gtk_widget_is_visible (widget))
+            priv->last_visible_child = priv->visible_child;
+          else
+            set_page_child_visible (stack, priv->visible_child->widget, FALSE);
+        }
     }
 
+  old_info = priv->visible_child;
   priv->visible_child = child_info;
 
   if (child_info)
-    gtk_widget_set_child_visible (child_info->widget, TRUE);
+    set_page_child_visible (stack, child_info->widget, TRUE);
+  p_stack_page_shown (stack, child_info);
 
+  /* Redrawing the stack for the switch is no change to the pages, so
+     it leaves their snapshots alone */
+  priv->switching_pages = TRUE;
   gtk_widget_queue_resize (GTK_WIDGET (stack));
   gtk_widget_queue_draw (GTK_WIDGET (stack));
+  priv->switching_pages = FALSE;
 
   g_object_notify (G_OBJECT (stack), "visible-child");
   g_object_notify (G_OBJECT (stack), "visible-child-name");
 
-  p_stack_start_transition (stack, transition_type, transition_duration);
+  if (!retargeted)
+    p_stack_start_transition (stack, transition_type, transition_duration);
+  p_stack_page_hidden (stack, old_info);
+  p_stack_prewarm_adjacent (stack);
 }
 
 static void
@@ -912,6 +1305,7 @@ stack_child_visibility_notify_cb (GObject    *obj,
   PStackChildInfo *child_info;
 
   child_info = find_child_info_for_widget (stack, child);
+  priv->hidden_size_cached = 0;
 
   if (priv->visible_child == NULL &&
       gtk_widget_get_visible (child))
@@ -922,7 +1316,7 @@ stack_child_visibility_notify_cb (GObject    *obj,
 
   if (child_info == priv->last_visible_child)
     {
-      gtk_widget_set_child_visible (priv->last_visible_child->widget, FALSE);
+      set_page_child_visible (stack, priv->last_visible_child->widget, FALSE);
       priv->last_visible_child = NULL;
     }
 }
@@ -983,123 +1377,566 @@ p_stack_add_named (PStack   *stack,
 }
 
 static void
-p_stack_add (GtkContainer *container,
-              GtkWidget     *child)
+p_stack_lazy_page_free (PStackLazyPage *lazy)
 {
-  PStack *stack = P_STACK (container);
-  PStackPrivate *priv = stack->priv;
-  PStackChildInfo *child_info;
-
-  g_return_if_fail (child != NULL);
-
-  child_info = g_slice_new (PStackChildInfo);
-  child_info->widget = child;
-  child_info->name = NULL;
-  child_info->title = NULL;
-  child_info->icon_name = NULL;
+  if (lazy->factory_target_destroy_notify != NULL)
+    lazy->factory_target_destroy_notify (lazy->factory_target);
+  g_free (lazy->name);
+  g_free (lazy->title);
+  g_slice_free (PStackLazyPage, lazy);
+}
 
-  priv->children = g_list_append (priv->children, child_info);
+static PStackChildInfo *
+p_stack_load_lazy_page (PStack       *stack,
+                        PStackLazyPage *lazy)
+{
+  PStackChildInfo *info;
+  GtkWidget *child;
 
-  gtk_widget_set_parent_window (child, priv->bin_window);
-  gtk_widget_set_parent (child, GTK_WIDGET (stack));
+  child = lazy->factory (stack, lazy->name, lazy->factory_target);
+  g_return_val_if_fail (GTK_IS_WIDGET (child), NULL);
 
-  g_signal_connect (child, "notify::visible",
-                    G_CALLBACK (stack_child_visibility_notify_cb), stack);
+  gtk_widget_show (child);
+  gtk_container_add_with_properties (GTK_CONTAINER (stack),
+                                     child,
+                                     "name", lazy->name,
+                                     "title", lazy->title,
+                                     NULL);
+  info = find_child_info_for_widget (stack, child);
+  info->lazy = lazy;
+  lazy->info = info;
 
-  gtk_widget_child_notify (child, "position");
+  return info;
+}
 
-  if (priv->visible_child == NULL &&
-      gtk_widget_get_visible (child))
-    set_visible_child (stack, child_info, priv->transition_type, priv->transition_duration);
-  else
-    gtk_widget_set_child_visible (child, FALSE);
+static void
+p_stack_unload_lazy_page (PStack       *stack,
+                          PStackLazyPage *lazy)
+{
+  GtkWidget *child = lazy->info->widget;
 
-  if (priv->homogeneous || priv->visible_child == child_info)
-    gtk_widget_queue_resize (GTK_WIDGET (stack));
+  g_signal_emit (stack, signals[PAGE_UNLOADED], 0, child, lazy->name);
+  /* Removing the page takes it off the list */
+  if (lazy->info != NULL)
+    gtk_widget_destroy (child);
 }
 
+static gboolean p_stack_unload_timeout (gpointer user_data);
+
+/* Unloads the pages hidden the longest, while there are more than
+   allowed or they have been hidden for too long. A page that is still
+   transitioning out stays until the next time. */
 static void
-p_stack_remove (GtkContainer *container,
-                  GtkWidget    *child)
+p_stack_unload_pages (PStack *stack)
 {
-  PStack *stack = P_STACK (container);
   PStackPrivate *priv = stack->priv;
-  PStackChildInfo *child_info;
-  gboolean was_visible;
+  PStackLazyPage *lazy;
+  GList *l, *prev;
+  gint64 now, oldest;
 
-  child_info = find_child_info_for_widget (stack, child);
-  if (child_info == NULL)
-    return;
+  now = g_get_monotonic_time ();
+  oldest = now;
 
-  priv->children = g_list_remove (priv->children, child_info);
+  for (l = priv->unloadable.tail; l != NULL; l = prev)
+    {
+      prev = l->prev;
+      lazy = l->data;
+      if (lazy->info == priv->last_visible_child)
+        continue;
 
-  g_signal_handlers_disconnect_by_func (child,
-                                        stack_child_visibility_notify_cb,
-                                        stack);
+      if (g_queue_get_length (&priv->unloadable) > priv->max_hidden_pages ||
+          (priv->unload_timeout > 0 &&
+           now - lazy->hidden_time >= (gint64) priv->unload_timeout * 1000))
+        p_stack_unload_lazy_page (stack, lazy);
+      else
+        {
+          oldest = lazy->hidden_time;
+          break;
+        }
+    }
 
-  was_visible = gtk_widget_get_visible (child);
+  if (priv->unload_timeout > 0 &&
+      priv->unload_timeout_id == 0 &&
+      priv->unloadable.length > 0)
+    priv->unload_timeout_id =
+      g_timeout_add (MAX (priv->unload_timeout - (now - oldest) / 1000, 1),
+                     p_stack_unload_timeout, stack);
+}
 
-  child_info->widget = NULL;
+static gboolean
+p_stack_unload_timeout (gpointer user_data)
+{
+  PStack *stack = user_data;
 
-  if (priv->visible_child == child_info)
-    set_visible_child (stack, NULL, priv->transition_type, priv->transition_duration);
+  stack->priv->unload_timeout_id = 0;
+  p_stack_unload_pages (stack);
 
-  if (priv->last_visible_child == child_info)
-    priv->last_visible_child = NULL;
+  return FALSE;
+}
 
-  gtk_widget_unparent (child);
+static void
+p_stack_page_shown (PStack        *stack,
+                    PStackChildInfo *info)
+{
+  PStackPrivate *priv = stack->priv;
 
-  g_free (child_info->name);
-  g_free (child_info->title);
-  g_free (child_info->icon_name);
-  g_slice_free (PStackChildInfo, child_info);
+  if (info != NULL)
+    info->warm = TRUE;
+  if (info == NULL || info->lazy == NULL || info->lazy->link == NULL)
+    return;
 
-  if (priv->homogeneous && was_visible)
-    gtk_widget_queue_resize (GTK_WIDGET (stack));
+  g_queue_delete_link (&priv->unloadable, info->lazy->link);
+  info->lazy->link = NULL;
+}
+
+static void
+p_stack_page_hidden (PStack        *stack,
+                     PStackChildInfo *info)
+{
+  PStackPrivate *priv = stack->priv;
+
+  if (info == NULL || info->widget == NULL || info->lazy == NULL ||
+      info == priv->visible_child || info->lazy->link != NULL)
+    return;
+
+  info->lazy->hidden_time = g_get_monotonic_time ();
+  g_queue_push_head (&priv->unloadable, info->lazy);
+  info->lazy->link = priv->unloadable.head;
+  p_stack_unload_pages (stack);
 }
 
 /*
- * p_stack_set_homogeneous:
+ * p_stack_add_lazy:
  * @stack: a #PStack
- * @homogeneous: %TRUE to make @stack homogeneous
+ * @name: the name for the page
+ * @title: (allow-none): a human-readable title for the page
+ * @factory: builds the page
+ * @factory_target: (allow-none): user data for @factory
+ * @factory_target_destroy_notify: (allow-none): destroys @factory_target
  *
- * Sets the #PStack to be homogeneous or not. If it
- * is homogeneous, the #PStack will request the same
- * size for all its children. If it isn't, the stack
- * may change size when a different child becomes visible.
+ * Adds a page to @stack that is only built by @factory when it is
+ * first made visible by name, with p_stack_set_visible_child_name()
+ * or p_stack_set_visible_child_full(). The page is then added with
+ * @name and @title, and shown.
  *
- * Since: 3.10
+ * Once hidden the page may be destroyed again, see
+ * p_stack_set_unload_policy(), and is then built anew the next time.
  */
 void
-p_stack_set_homogeneous (PStack *stack,
-                           gboolean  homogeneous)
+p_stack_add_lazy (PStack          *stack,
+                  const gchar       *name,
+                  const gchar       *title,
+                  PStackPageFactory  factory,
+                  gpointer           factory_target,
+                  GDestroyNotify     factory_target_destroy_notify)
 {
   PStackPrivate *priv;
+  PStackLazyPage *lazy;
 
   g_return_if_fail (P_IS_STACK (stack));
+  g_return_if_fail (name != NULL);
+  g_return_if_fail (factory != NULL);
 
   priv = stack->priv;
+  if (find_child_info_for_name (stack, name) != NULL ||
+      g_hash_table_lookup (priv->lazy_pages, name) != NULL)
+    {
+      g_warning ("Duplicate child name in PStack: %s\n", name);
+      return;
+    }
 
-  homogeneous = !!homogeneous;
-
-  if (priv->homogeneous == homogeneous)
-    return;
-
-  priv->homogeneous = homogeneous;
-
-  if (gtk_widget_get_visible (GTK_WIDGET(stack)))
-    gtk_widget_queue_resize (GTK_WIDGET (stack));
-
-  g_object_notify (G_OBJECT (stack), "homogeneous");
+  lazy = g_slice_new0 (PStackLazyPage);
+  lazy->name = g_strdup (name);
+  lazy->title = g_strdup (title);
+  lazy->factory = factory;
+  lazy->factory_target = factory_target;
+  lazy->factory_target_destroy_notify = factory_target_destroy_notify;
+  g_hash_table_insert (priv->lazy_pages, lazy->name, lazy);
 }
 
 /*
- * p_stack_get_homogeneous:
+ * p_stack_set_unload_policy:
  * @stack: a #PStack
+ * @timeout: milliseconds after which a hidden page is destroyed, or 0
+ * @max_hidden_pages: how many hidden pages are kept at most
+ *
+ * Sets when pages added with p_stack_add_lazy() are destroyed again
+ * after they were hidden, the least recently shown first.
+ * #PStack::page-unloaded is emitted before that. By default they
+ * are kept.
+ */
+void
+p_stack_set_unload_policy (PStack *stack,
+                           guint     timeout,
+                           guint     max_hidden_pages)
+{
+  PStackPrivate *priv;
+
+  g_return_if_fail (P_IS_STACK (stack));
+
+  priv = stack->priv;
+  priv->unload_timeout = timeout;
+  priv->max_hidden_pages = max_hidden_pages;
+  if (priv->unload_timeout_id != 0)
+    {
+      g_source_remove (priv->unload_timeout_id);
+      priv->unload_timeout_id = 0;
+    }
+  p_stack_unload_pages (stack);
+}
+
+/* Prewarming. A hidden page is measured, realized and allocated at
+   the size of the stack during idle time, so that the first frame of
+   a transition to it only has to map and paint it. It is not drawn:
+   that needs it child visible, which would map it. */
+
+/* Returns FALSE if the stack has no size yet to warm info at */
+static gboolean
+p_stack_warm_page (PStack        *stack,
+                   PStackChildInfo *info)
+{
+  PStackPrivate *priv = stack->priv;
+  GtkAllocation allocation, child_allocation;
+  gint child_min, child_nat;
+
+  if (info->warm || info == priv->visible_child)
+    return TRUE;
+
+  gtk_widget_get_allocation (GTK_WIDGET (stack), &allocation);
+  gtk_widget_get_preferred_width (info->widget, &child_min, &child_nat);
+  gtk_widget_get_preferred_height_for_width (info->widget, allocation.width,
+                                             &child_min, &child_nat);
+
+  if (!gtk_widget_get_mapped (GTK_WIDGET (stack)) ||
+      allocation.width <= 1 || allocation.height <= 1)
+    return FALSE;
+
+  gtk_widget_realize (info->widget);
+  child_allocation.x = 0;
+  child_allocation.y = 0;
+  child_allocation.width = allocation.width;
+  child_allocation.height = allocation.height;
+  gtk_widget_size_allocate (info->widget, &child_allocation);
+
+  info->warm = TRUE;
+
+  return TRUE;
+}
+
+/* Warms one page per idle, pages that still have to be built first */
+static gboolean
+p_stack_prewarm_step (gpointer user_data)
+{
+  PStack *stack = user_data;
+  PStackPrivate *priv = stack->priv;
+  PStackChildInfo *info;
+  PStackLazyPage *lazy;
+  gchar *name;
+
+  name = g_queue_pop_head (&priv->prewarm_names);
+  if (name != NULL)
+    {
+      info = find_child_info_for_name (stack, name);
+      lazy = g_hash_table_lookup (priv->lazy_pages, name);
+      if (info == NULL && lazy != NULL)
+        {
+          /* Counts as hidden from now on, which may unload it again */
+          p_stack_page_hidden (stack, p_stack_load_lazy_page (stack, lazy));
+          info = find_child_info_for_name (stack, name);
+        }
+      g_free (name);
+    }
+  else
+    info = g_queue_pop_head (&priv->prewarm_children);
+
+  /* Tried again once the stack has a size */
+  if (info != NULL && info->widget != NULL &&
+      !p_stack_warm_page (stack, info))
+    {
+      g_queue_push_head (&priv->prewarm_children, info);
+      priv->prewarm_id = 0;
+      return FALSE;
+    }
+
+  if (g_queue_is_empty (&priv->prewarm_names) &&
+      g_queue_is_empty (&priv->prewarm_children))
+    {
+      priv->prewarm_id = 0;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+p_stack_schedule_prewarm (PStack *stack)
+{
+  PStackPrivate *priv = stack->priv;
+
+  if (priv->prewarm_id == 0)
+    priv->prewarm_id = g_idle_add_full (G_PRIORITY_LOW, p_stack_prewarm_step, stack, NULL);
+}
+
+static void
+p_stack_queue_prewarm (PStack        *stack,
+                       PStackChildInfo *info)
+{
+  PStackPrivate *priv = stack->priv;
+
+  if (info->warm ||
+      info == priv->visible_child ||
+      g_queue_find (&priv->prewarm_children, info) != NULL)
+    return;
+
+  g_queue_push_tail (&priv->prewarm_children, info);
+  p_stack_schedule_prewarm (stack);
+}
+
+/* Pages next to the visible one are the likely next ones */
+static void
+p_stack_prewarm_adjacent (PStack *stack)
+{
+  PStackPrivate *priv = stack->priv;
+  GSequenceIter *iter;
+
+  if (!priv->prewarm_adjacent || priv->visible_child == NULL)
+    return;
+
+  iter = priv->visible_child->iter;
+  if (!g_sequence_iter_is_begin (iter))
+    p_stack_queue_prewarm (stack, g_sequence_get (g_sequence_iter_prev (iter)));
+  iter = g_sequence_iter_next (iter);
+  if (!g_sequence_iter_is_end (iter))
+    p_stack_queue_prewarm (stack, g_sequence_get (iter));
+}
+
+/*
+ * p_stack_prewarm_child:
+ * @stack: a #PStack
+ * @child: a hidden child of @stack
+ *
+ * Prepares @child for being shown during idle time: it is measured,
+ * realized and allocated, so the transition to it starts without
+ * stalling. @child stays unmapped, it gets no map or unmap events
+ * and its windows are not shown. Pages that were shown before are
+ * already warm.
+ */
+void
+p_stack_prewarm_child (PStack  *stack,
+                       GtkWidget *child)
+{
+  PStackChildInfo *info;
+
+  g_return_if_fail (P_IS_STACK (stack));
+  g_return_if_fail (GTK_IS_WIDGET (child));
+
+  info = find_child_info_for_widget (stack, child);
+  if (info != NULL)
+    p_stack_queue_prewarm (stack, info);
+}
+
+/*
+ * p_stack_prewarm_child_name:
+ * @stack: a #PStack
+ * @name: the name of a hidden child of @stack
+ *
+ * Like p_stack_prewarm_child(), for the child with @name. A page added
+ * with p_stack_add_lazy() is built first if it was not yet.
+ */
+void
+p_stack_prewarm_child_name (PStack   *stack,
+                            const gchar *name)
+{
+  PStackPrivate *priv;
+  PStackChildInfo *info;
+
+  g_return_if_fail (P_IS_STACK (stack));
+  g_return_if_fail (name != NULL);
+
+  priv = stack->priv;
+  info = find_child_info_for_name (stack, name);
+  if (info != NULL)
+    p_stack_queue_prewarm (stack, info);
+  else if (g_hash_table_lookup (priv->lazy_pages, name) != NULL)
+    {
+      g_queue_push_tail (&priv->prewarm_names, g_strdup (name));
+      p_stack_schedule_prewarm (stack);
+    }
+}
+
+/*
+ * p_stack_set_prewarm_adjacent:
+ * @stack: a #PStack
+ * @prewarm_adjacent: whether to prewarm the pages next to the visible one
+ *
+ * If set, each time the visible child changes the pages before and
+ * after it are prewarmed, see p_stack_prewarm_child().
+ */
+void
+p_stack_set_prewarm_adjacent (PStack *stack,
+                              gboolean  prewarm_adjacent)
+{
+  g_return_if_fail (P_IS_STACK (stack));
+
+  stack->priv->prewarm_adjacent = prewarm_adjacent;
+  p_stack_prewarm_adjacent (stack);
+}
+
+static void
+p_stack_add (GtkContainer *container,
+              GtkWidget     *child)
+{
+  PStack *stack = P_STACK (container);
+  PStackPrivate *priv = stack->priv;
+  PStackChildInfo *child_info;
+
+  g_return_if_fail (child != NULL);
+
+  child_info = g_slice_new (PStackChildInfo);
+  child_info->widget = child;
+  child_info->name = NULL;
+  child_info->title = NULL;
+  child_info->icon_name = NULL;
+  child_info->lazy = NULL;
+  child_info->warm = FALSE;
+  child_info->snapshot = NULL;
+  child_info->snapshot_link = NULL;
+  child_info->snapshot_bytes = 0;
+  child_info->size_cached = 0;
+
+  child_info->iter = g_sequence_append (priv->children, child_info);
+  g_object_set_qdata (G_OBJECT (child), child_info_quark, child_info);
+
+  gtk_widget_set_parent_window (child, priv->bin_window);
+  gtk_widget_set_parent (child, GTK_WIDGET (stack));
+
+  g_signal_connect (child, "notify::visible",
+                    G_CALLBACK (stack_child_visibility_notify_cb), stack);
+  g_signal_connect (child, "size-allocate",
+                    G_CALLBACK (stack_child_size_allocate_cb), stack);
+  priv->hidden_size_cached = 0;
+
+  gtk_widget_child_notify (child, "position");
+
+  if (priv->visible_child == NULL &&
+      gtk_widget_get_visible (child))
+    set_visible_child (stack, child_info, priv->transition_type, priv->transition_duration);
+  else
+    set_page_child_visible (stack, child, FALSE);
+
+  if (priv->homogeneous || priv->visible_child == child_info)
+    gtk_widget_queue_resize (GTK_WIDGET (stack));
+}
+
+static void
+p_stack_remove (GtkContainer *container,
+                  GtkWidget    *child)
+{
+  PStack *stack = P_STACK (container);
+  PStackPrivate *priv = stack->priv;
+  PStackChildInfo *child_info;
+  gboolean was_visible;
+
+  child_info = find_child_info_for_widget (stack, child);
+  if (child_info == NULL)
+    return;
+
+  unindex_child_name (stack, child_info);
+  g_sequence_remove (child_info->iter);
+  g_queue_remove (&priv->prewarm_children, child_info);
+  if (child_info->lazy != NULL)
+    {
+      if (child_info->lazy->link != NULL)
+        g_queue_delete_link (&priv->unloadable, child_info->lazy->link);
+      child_info->lazy->link = NULL;
+      child_info->lazy->info = NULL;
+      child_info->lazy = NULL;
+    }
+  g_object_set_qdata (G_OBJECT (child), child_info_quark, NULL);
+
+  g_signal_handlers_disconnect_by_func (child,
+                                        stack_child_visibility_notify_cb,
+                                        stack);
+  g_signal_handlers_disconnect_by_func (child,
+                                        stack_child_size_allocate_cb,
+                                        stack);
+  p_stack_drop_snapshot (stack, child_info);
+  priv->hidden_size_cached = 0;
+
+  was_visible = gtk_widget_get_visible (child);
+
+  child_info->widget = NULL;
+
+  if (priv->visible_child == child_info)
+    set_visible_child (stack, NULL, priv->transition_type, priv->transition_duration);
+
+  if (priv->last_visible_child == child_info)
+    priv->last_visible_child = NULL;
+  if (priv->last_visible_surface_child == child_info)
+    priv->last_visible_surface_child = NULL;
+
+  gtk_widget_unparent (child);
+
+  g_free (child_info->name);
+  g_free (child_info->title);
+  g_free (child_info->icon_name);
+  g_slice_free (PStackChildInfo, child_info);
+
+  if (priv->homogeneous && was_visible)
+    gtk_widget_queue_resize (GTK_WIDGET (stack));
+}
+
+/*
+ * p_stack_set_homogeneous:
+ * @stack: a #PStack
+ * @homogeneous: %TRUE to make @stack homogeneous
+ *
+ * Sets the #PStack to be homogeneous or not. If it
+ * is homogeneous, the #PStack will request the same
+ * size for all its children. If it isn't, the stack
+ * may change size when a different child becomes visible.
+ *
+ * Since: 3.10
+ */
+void
+p_stack_set_homogeneous (PStack *stack,
+                           gboolean  homogeneous)
+{
+  PStackPrivate *priv;
+  GSequenceIter *iter;
+
+  g_return_if_fail (P_IS_STACK (stack));
+
+  priv = stack->priv;
+
+  homogeneous = !!homogeneous;
+
+  if (priv->homogeneous == homogeneous)
+    return;
+
+  priv->homogeneous = homogeneous;
+
+  /* Hidden pages are not allocated while the stack is not
+     homogeneous, so their cached sizes cannot be trusted */
+  for (iter = g_sequence_get_begin_iter (priv->children);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    ((PStackChildInfo *) g_sequence_get (iter))->size_cached = 0;
+  priv->hidden_size_cached = 0;
+
+  if (gtk_widget_get_visible (GTK_WIDGET(stack)))
+    gtk_widget_queue_resize (GTK_WIDGET (stack));
+
+  g_object_notify (G_OBJECT (stack), "homogeneous");
+}
+
+/*
+ * p_stack_get_homogeneous:
+ * @stack: a #PStack
+ *
+ * Gets whether @stack is homogeneous.
+ * See p_stack_set_homogeneous().
  *
- * Gets whether @stack is homogeneous.
- * See p_stack_set_homogeneous().
- *
  * Return value: whether @stack is homogeneous.
  *
  * Since: 3.10
@@ -1306,26 +2143,22 @@ p_stack_set_visible_child_full (PStack               *stack,
                                   PStackTransitionType  transition)
 {
   PStackPrivate *priv;
-  PStackChildInfo *child_info, *info;
-  GList *l;
+  PStackChildInfo *child_info;
 
   g_return_if_fail (P_IS_STACK (stack));
   g_return_if_fail (name != NULL);
 
   priv = stack->priv;
 
-  child_info = NULL;
-  for (l = priv->children; l != NULL; l = l->next)
+  child_info = find_child_info_for_name (stack, name);
+  if (child_info == NULL)
     {
-      info = l->data;
-      if (info->name != NULL &&
-          strcmp (info->name, name) == 0)
-        {
-          child_info = info;
-          break;
-        }
-    }
+      PStackLazyPage *lazy;
 
+      lazy = g_hash_table_lookup (priv->lazy_pages, name);
+      if (lazy != NULL)
+        child_info = p_stack_load_lazy_page (stack, lazy);
+    }
   if (child_info != NULL && gtk_widget_get_visible (child_info->widget))
     set_visible_child (stack, child_info, transition, priv->transition_duration);
 }
@@ -1339,13 +2172,13 @@ p_stack_forall (GtkContainer *container,
   PStack *stack = P_STACK (container);
   PStackPrivate *priv = stack->priv;
   PStackChildInfo *child_info;
-  GList *l;
+  GSequenceIter *iter;
 
-  l = priv->children;
-  while (l)
+  iter = g_sequence_get_begin_iter (priv->children);
+  while (!g_sequence_iter_is_end (iter))
     {
-      child_info = l->data;
-      l = l->next;
+      child_info = g_sequence_get (iter);
+      iter = g_sequence_iter_next (iter);
 
       (* callback) (child_info->widget, callback_data);
     }
@@ -1361,13 +2194,15 @@ p_stack_compute_expand (GtkWidget *widget,
   gboolean hexpand, vexpand;
   PStackChildInfo *child_info;
   GtkWidget *child;
-  GList *l;
+  GSequenceIter *iter;
 
   hexpand = FALSE;
   vexpand = FALSE;
-  for (l = priv->children; l != NULL; l = l->next)
+  for (iter = g_sequence_get_begin_iter (priv->children);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
     {
-      child_info = l->data;
+      child_info = g_sequence_get (iter);
       child = child_info->widget;
 
       if (!hexpand &&
@@ -1392,6 +2227,8 @@ p_stack_draw_crossfade (GtkWidget *widget,
 {
   PStack *stack = P_STACK (widget);
   PStackPrivate *priv = stack->priv;
+  GtkAllocation allocation;
+  cairo_t *pattern_cr;
 
   if (priv->last_visible_surface)
     {
@@ -1402,6 +2239,39 @@ p_stack_draw_crossfade (GtkWidget *widget,
       cairo_paint_with_alpha (cr, MAX (1.0 - priv->transition_pos, 0));
     }
 
+  /* Draw the incoming page once and blend the two snapshots on every
+     frame after, unless it keeps drawing anew */
+  gtk_widget_get_allocation (priv->visible_child->widget, &allocation);
+  if (priv->visible_surface != NULL &&
+      (priv->visible_surface_allocation.width != allocation.width ||
+       priv->visible_surface_allocation.height != allocation.height))
+    p_stack_clear_visible_surface (stack);
+
+  /* Not from the snapshot cache, the page may have changed while it
+     was hidden */
+  if (priv->visible_surface == NULL && !priv->visible_surface_stale)
+    {
+      priv->visible_surface_allocation = allocation;
+      priv->visible_surface =
+        gdk_window_create_similar_surface (gtk_widget_get_window (widget),
+                                           CAIRO_CONTENT_COLOR_ALPHA,
+                                           allocation.width,
+                                           allocation.height);
+      pattern_cr = cairo_create (priv->visible_surface);
+      gtk_widget_draw (priv->visible_child->widget, pattern_cr);
+      cairo_destroy (pattern_cr);
+    }
+
+  if (priv->visible_surface != NULL)
+    {
+      cairo_set_source_surface (cr, priv->visible_surface,
+                                priv->visible_surface_allocation.x,
+                                priv->visible_surface_allocation.y);
+      cairo_set_operator (cr, CAIRO_OPERATOR_ADD);
+      cairo_paint_with_alpha (cr, priv->transition_pos);
+      return;
+    }
+
   cairo_push_group (cr);
   cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
   gtk_container_propagate_draw (GTK_CONTAINER (stack),
@@ -1451,6 +2321,200 @@ p_stack_draw_slide (GtkWidget *widget,
                                 cr);
 }
 
+/* Snapshot cache. The page a transition leaves is drawn into a surface
+   once, and that surface is kept for the next time the page is left
+   again. It is dropped when the page is drawn anew while visible, gets
+   another allocation or is resized, and the least recently used ones
+   go once the cache is over its size. */
+
+static void
+p_stack_drop_snapshot (PStack        *stack,
+                       PStackChildInfo *info)
+{
+  PStackPrivate *priv = stack->priv;
+
+  if (info->snapshot == NULL)
+    return;
+
+  g_queue_delete_link (&priv->snapshots, info->snapshot_link);
+  priv->snapshot_bytes -= info->snapshot_bytes;
+  cairo_surface_destroy (info->snapshot);
+  info->snapshot = NULL;
+  info->snapshot_link = NULL;
+  info->snapshot_bytes = 0;
+}
+
+static void
+p_stack_drop_snapshots (PStack *stack,
+                        gsize     limit)
+{
+  PStackPrivate *priv = stack->priv;
+
+  while (priv->snapshot_bytes > limit)
+    p_stack_drop_snapshot (stack, g_queue_peek_tail (&priv->snapshots));
+}
+
+/* Returns a new reference to the snapshot of info, if it has one of
+   the size of allocation */
+static cairo_surface_t *
+p_stack_lookup_snapshot (PStack        *stack,
+                         PStackChildInfo *info,
+                         GtkAllocation   *allocation)
+{
+  PStackPrivate *priv = stack->priv;
+
+  if (info->snapshot == NULL)
+    return NULL;
+
+  if (info->snapshot_allocation.width != allocation->width ||
+      info->snapshot_allocation.height != allocation->height)
+    {
+      p_stack_drop_snapshot (stack, info);
+      return NULL;
+    }
+
+  g_queue_unlink (&priv->snapshots, info->snapshot_link);
+  g_queue_push_head_link (&priv->snapshots, info->snapshot_link);
+  return cairo_surface_reference (info->snapshot);
+}
+
+static void
+p_stack_keep_snapshot (PStack        *stack,
+                       PStackChildInfo *info,
+                       cairo_surface_t *surface,
+                       GtkAllocation   *allocation)
+{
+  PStackPrivate *priv = stack->priv;
+  gsize bytes;
+  gint scale;
+
+  p_stack_drop_snapshot (stack, info);
+
+#if HAVE_INVALIDATE_HANDLER
+  scale = gdk_window_get_scale_factor (priv->bin_window);
+#else
+  scale = 1;
+#endif
+  bytes = (gsize) allocation->width * allocation->height * scale * scale * 4;
+  if (bytes > priv->snapshot_cache_size)
+    return;
+
+  p_stack_drop_snapshots (stack, priv->snapshot_cache_size - bytes);
+  info->snapshot = cairo_surface_reference (surface);
+  info->snapshot_allocation = *allocation;
+  info->snapshot_bytes = bytes;
+  g_queue_push_head (&priv->snapshots, info);
+  info->snapshot_link = priv->snapshots.head;
+  priv->snapshot_bytes += bytes;
+}
+
+#if HAVE_INVALIDATE_HANDLER
+/* Anything drawn anew in the bin window is part of the visible page */
+static void
+p_stack_bin_window_invalidated (GdkWindow    *window,
+                                cairo_region_t *region)
+{
+  PStack *stack;
+
+  gdk_window_get_user_data (window, (gpointer *) &stack);
+  if (stack == NULL ||
+      stack->priv->visible_child == NULL ||
+      stack->priv->switching_pages)
+    return;
+
+  p_stack_drop_snapshot (stack, stack->priv->visible_child);
+
+  /* The incoming page changed after it was taken, draw it live for
+     the rest of the crossfade rather than taking it every frame */
+  if (stack->priv->visible_surface != NULL)
+    {
+      p_stack_clear_visible_surface (stack);
+      stack->priv->visible_surface_stale = TRUE;
+    }
+}
+#endif
+
+static void
+get_child_preferred_size (GtkWidget *child,
+                          gint       slot,
+                          gint       for_size,
+                          gint      *minimum,
+                          gint      *natural)
+{
+  switch (slot)
+    {
+    case SIZE_WIDTH:
+      gtk_widget_get_preferred_width (child, minimum, natural);
+      break;
+    case SIZE_WIDTH_FOR_HEIGHT:
+      gtk_widget_get_preferred_width_for_height (child, for_size, minimum, natural);
+      break;
+    case SIZE_HEIGHT:
+      gtk_widget_get_preferred_height (child, minimum, natural);
+      break;
+    case SIZE_HEIGHT_FOR_WIDTH:
+      gtk_widget_get_preferred_height_for_width (child, for_size, minimum, natural);
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+stack_child_size_allocate_cb (GtkWidget     *child,
+                              GtkAllocation *allocation,
+                              gpointer       user_data)
+{
+  PStack *stack = P_STACK (user_data);
+  PStackPrivate *priv = stack->priv;
+  PStackChildInfo *info;
+
+  info = find_child_info_for_widget (stack, child);
+  if (info == NULL)
+    return;
+
+  p_stack_drop_snapshot (stack, info);
+
+  /* The sizes a page had while hidden may not hold once it was laid
+     out, and a prewarmed page is measured with the others again */
+  if (info->size_cached == 0)
+    return;
+
+  info->size_cached = 0;
+  priv->hidden_size_cached = 0;
+
+  if (info != priv->visible_child && info != priv->last_visible_child)
+    gtk_widget_queue_resize_no_redraw (GTK_WIDGET (stack));
+}
+
+/*
+ * p_stack_set_snapshot_cache_size:
+ * @stack: a #PStack
+ * @size: the size of the cache in bytes, or 0
+ *
+ * Sets how much memory the snapshots of pages that were left in a
+ * transition may take. Leaving a page again reuses its snapshot if the
+ * page was not drawn anew or resized while visible, which is the
+ * costly part of starting a transition.
+ *
+ * A page that changes while hidden cannot be told apart, it would be
+ * left again with its old content. Only turn the cache on if hidden
+ * pages do not change. The default is 0, no cache. It stays off
+ * before GTK 3.10.
+ */
+void
+p_stack_set_snapshot_cache_size (PStack *stack,
+                                 gsize     size)
+{
+  g_return_if_fail (P_IS_STACK (stack));
+
+  /* Without an invalidate handler a page drawing anew goes unnoticed */
+#if HAVE_INVALIDATE_HANDLER
+  stack->priv->snapshot_cache_size = size;
+  p_stack_drop_snapshots (stack, size);
+#endif
+}
+
 static gboolean
 p_stack_draw (GtkWidget *widget,
                 cairo_t   *cr)
@@ -1468,6 +2532,14 @@ p_stack_draw (GtkWidget *widget,
             {
               gtk_widget_get_allocation (priv->last_visible_child->widget,
                                          &priv->last_visible_surface_allocation);
+              priv->last_visible_surface =
+                p_stack_lookup_snapshot (stack, priv->last_visible_child,
+                                         &priv->last_visible_surface_allocation);
+            }
+
+          if (priv->last_visible_surface == NULL &&
+              priv->last_visible_child != NULL)
+            {
               priv->last_visible_surface =
                 gdk_window_create_similar_surface (gtk_widget_get_window (widget),
                                                    CAIRO_CONTENT_COLOR_ALPHA,
@@ -1479,8 +2551,14 @@ p_stack_draw (GtkWidget *widget,
                */
               gtk_widget_draw (priv->last_visible_child->widget, pattern_cr);
               cairo_destroy (pattern_cr);
+              p_stack_keep_snapshot (stack, priv->last_visible_child,
+                                     priv->last_visible_surface,
+                                     &priv->last_visible_surface_allocation);
             }
 
+          if (priv->last_visible_child != NULL)
+            priv->last_visible_surface_child = priv->last_visible_child;
+
           switch (priv->active_transition_type)
             {
             case P_STACK_TRANSITION_TYPE_CROSSFADE:
@@ -1506,6 +2584,57 @@ p_stack_draw (GtkWidget *widget,
   return TRUE;
 }
 
+/* Takes the cached sizes of the hidden pages of a homogeneous stack
+   anew. That is a lookup in GTK's own request cache for the pages that
+   did not queue a resize since, so only those that did are measured
+   again. If any size moved, the stack is measured again. Hidden pages
+   are never allocated here. */
+static void
+p_stack_check_hidden_sizes (PStack *stack)
+{
+  PStackPrivate *priv = stack->priv;
+  PStackChildInfo *child_info;
+  GSequenceIter *iter;
+  gboolean changed;
+  gint slot, min, nat;
+
+  changed = FALSE;
+  for (iter = g_sequence_get_begin_iter (priv->children);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      child_info = g_sequence_get (iter);
+
+      if (child_info->size_cached == 0 ||
+          child_info == priv->visible_child ||
+          child_info == priv->last_visible_child ||
+          !gtk_widget_get_visible (child_info->widget))
+        continue;
+
+      for (slot = 0; slot < N_SIZE_SLOTS; slot++)
+        {
+          if ((child_info->size_cached & (1 << slot)) == 0)
+            continue;
+
+          get_child_preferred_size (child_info->widget, slot,
+                                    child_info->size_for[slot], &min, &nat);
+          if (min != child_info->size_min[slot] ||
+              nat != child_info->size_nat[slot])
+            {
+              child_info->size_min[slot] = min;
+              child_info->size_nat[slot] = nat;
+              changed = TRUE;
+            }
+        }
+    }
+
+  if (changed)
+    {
+      priv->hidden_size_cached = 0;
+      gtk_widget_queue_resize_no_redraw (GTK_WIDGET (stack));
+    }
+}
+
 static void
 p_stack_size_allocate (GtkWidget     *widget,
                          GtkAllocation *allocation)
@@ -1528,6 +2657,13 @@ p_stack_size_allocate (GtkWidget     *widget,
   if (priv->visible_child)
     gtk_widget_size_allocate (priv->visible_child->widget, &child_allocation);
 
+  if (priv->homogeneous)
+    p_stack_check_hidden_sizes (stack);
+
+  /* Prewarming waits for the stack to have a size */
+  if (!g_queue_is_empty (&priv->prewarm_children))
+    p_stack_schedule_prewarm (stack);
+
    if (gtk_widget_get_realized (widget))
     {
       gdk_window_move_resize (priv->view_window,
@@ -1539,164 +2675,163 @@ p_stack_size_allocate (GtkWidget     *widget,
     }
 }
 
+/* Hidden pages of a homogeneous stack are measured from their cache,
+   which is checked each time the stack is allocated */
 static void
-p_stack_get_preferred_height (GtkWidget *widget,
-                                gint      *minimum_height,
-                                gint      *natural_height)
+p_stack_measure_hidden_page (PStack          *stack,
+                             PStackChildInfo *info,
+                             gint             slot,
+                             gint             for_size,
+                             gint            *minimum,
+                             gint            *natural)
 {
-  PStack *stack = P_STACK (widget);
-  PStackPrivate *priv = stack->priv;
-  PStackChildInfo *child_info;
-  GtkWidget *child;
-  gint child_min, child_nat;
-  GList *l;
-
-  *minimum_height = 0;
-  *natural_height = 0;
-
-  for (l = priv->children; l != NULL; l = l->next)
+  if ((info->size_cached & (1 << slot)) == 0 ||
+      info->size_for[slot] != for_size)
     {
-      child_info = l->data;
-      child = child_info->widget;
-
-      if (!priv->homogeneous &&
-          (priv->visible_child != child_info &&
-           priv->last_visible_child != child_info))
-        continue;
-      if (gtk_widget_get_visible (child))
-        {
-          gtk_widget_get_preferred_height (child, &child_min, &child_nat);
-
-          *minimum_height = MAX (*minimum_height, child_min);
-          *natural_height = MAX (*natural_height, child_nat);
-        }
+      get_child_preferred_size (info->widget, slot, for_size,
+                                &info->size_min[slot], &info->size_nat[slot]);
+      info->size_for[slot] = for_size;
+      info->size_cached |= 1 << slot;
     }
 
-  if (priv->last_visible_surface != NULL)
-    {
-      *minimum_height = MAX (*minimum_height, priv->last_visible_surface_allocation.height);
-      *natural_height = MAX (*natural_height, priv->last_visible_surface_allocation.height);
-    }
+  *minimum = info->size_min[slot];
+  *natural = info->size_nat[slot];
 }
 
 static void
-p_stack_get_preferred_height_for_width (GtkWidget *widget,
-                                          gint       width,
-                                          gint      *minimum_height,
-                                          gint      *natural_height)
+p_stack_measure (PStack *stack,
+                 gint      slot,
+                 gint      for_size,
+                 gint     *minimum,
+                 gint     *natural)
 {
-  PStack *stack = P_STACK (widget);
   PStackPrivate *priv = stack->priv;
   PStackChildInfo *child_info;
   GtkWidget *child;
   gint child_min, child_nat;
-  GList *l;
+  GSequenceIter *iter;
 
-  *minimum_height = 0;
-  *natural_height = 0;
+  *minimum = 0;
+  *natural = 0;
 
-  for (l = priv->children; l != NULL; l = l->next)
+  if (priv->homogeneous)
     {
-      child_info = l->data;
-      child = child_info->widget;
+      if (priv->hidden_size_visible != priv->visible_child ||
+          priv->hidden_size_last != priv->last_visible_child)
+        {
+          priv->hidden_size_cached = 0;
+          priv->hidden_size_visible = priv->visible_child;
+          priv->hidden_size_last = priv->last_visible_child;
+        }
 
-      if (!priv->homogeneous &&
-          (priv->visible_child != child_info &&
-           priv->last_visible_child != child_info))
-        continue;
-      if (gtk_widget_get_visible (child))
+      if (priv->hidden_size_cached & (1 << slot))
+        {
+          *minimum = priv->hidden_size_min[slot];
+          *natural = priv->hidden_size_nat[slot];
+        }
+      else
         {
-          gtk_widget_get_preferred_height_for_width (child, width, &child_min, &child_nat);
+          for (iter = g_sequence_get_begin_iter (priv->children);
+               !g_sequence_iter_is_end (iter);
+               iter = g_sequence_iter_next (iter))
+            {
+              child_info = g_sequence_get (iter);
+
+              if (child_info == priv->visible_child ||
+                  child_info == priv->last_visible_child ||
+                  !gtk_widget_get_visible (child_info->widget))
+                continue;
+
+              p_stack_measure_hidden_page (stack, child_info, slot, for_size,
+                                           &child_min, &child_nat);
 
-          *minimum_height = MAX (*minimum_height, child_min);
-          *natural_height = MAX (*natural_height, child_nat);
+              *minimum = MAX (*minimum, child_min);
+              *natural = MAX (*natural, child_nat);
+            }
+
+          /* Only the unconstrained sizes are asked for repeatedly */
+          if (slot == SIZE_WIDTH || slot == SIZE_HEIGHT)
+            {
+              priv->hidden_size_min[slot] = *minimum;
+              priv->hidden_size_nat[slot] = *natural;
+              priv->hidden_size_cached |= 1 << slot;
+            }
         }
     }
 
-  if (priv->last_visible_surface != NULL)
+  if (priv->visible_child != NULL)
     {
-      *minimum_height = MAX (*minimum_height, priv->last_visible_surface_allocation.height);
-      *natural_height = MAX (*natural_height, priv->last_visible_surface_allocation.height);
-    }
-}
-
-static void
-p_stack_get_preferred_width (GtkWidget *widget,
-                               gint      *minimum_width,
-                               gint      *natural_width)
-{
-  PStack *stack = P_STACK (widget);
-  PStackPrivate *priv = stack->priv;
-  PStackChildInfo *child_info;
-  GtkWidget *child;
-  gint child_min, child_nat;
-  GList *l;
+      child = priv->visible_child->widget;
+      if (gtk_widget_get_visible (child))
+        {
+          get_child_preferred_size (child, slot, for_size, &child_min, &child_nat);
 
-  *minimum_width = 0;
-  *natural_width = 0;
+          *minimum = MAX (*minimum, child_min);
+          *natural = MAX (*natural, child_nat);
+        }
+    }
 
-  for (l = priv->children; l != NULL; l = l->next)
+  if (priv->last_visible_child != NULL)
     {
-      child_info = l->data;
-      child = child_info->widget;
-
-      if (!priv->homogeneous &&
-          (priv->visible_child != child_info &&
-           priv->last_visible_child != child_info))
-        continue;
+      child = priv->last_visible_child->widget;
       if (gtk_widget_get_visible (child))
         {
-          gtk_widget_get_preferred_width (child, &child_min, &child_nat);
+          get_child_preferred_size (child, slot, for_size, &child_min, &child_nat);
 
-          *minimum_width = MAX (*minimum_width, child_min);
-          *natural_width = MAX (*natural_width, child_nat);
+          *minimum = MAX (*minimum, child_min);
+          *natural = MAX (*natural, child_nat);
         }
     }
 
   if (priv->last_visible_surface != NULL)
     {
-      *minimum_width = MAX (*minimum_width, priv->last_visible_surface_allocation.width);
-      *natural_width = MAX (*natural_width, priv->last_visible_surface_allocation.width);
+      if (slot == SIZE_WIDTH || slot == SIZE_WIDTH_FOR_HEIGHT)
+        {
+          *minimum = MAX (*minimum, priv->last_visible_surface_allocation.width);
+          *natural = MAX (*natural, priv->last_visible_surface_allocation.width);
+        }
+      else
+        {
+          *minimum = MAX (*minimum, priv->last_visible_surface_allocation.height);
+          *natural = MAX (*natural, priv->last_visible_surface_allocation.height);
+        }
     }
 }
 
+static void
+p_stack_get_preferred_height (GtkWidget *widget,
+                                gint      *minimum_height,
+                                gint      *natural_height)
+{
+  p_stack_measure (P_STACK (widget), SIZE_HEIGHT, -1,
+                   minimum_height, natural_height);
+}
+
+static void
+p_stack_get_preferred_height_for_width (GtkWidget *widget,
+                                          gint       width,
+                                          gint      *minimum_height,
+                                          gint      *natural_height)
+{
+  p_stack_measure (P_STACK (widget), SIZE_HEIGHT_FOR_WIDTH, width,
+                   minimum_height, natural_height);
+}
+
+static void
+p_stack_get_preferred_width (GtkWidget *widget,
+                               gint      *minimum_width,
+                               gint      *natural_width)
+{
+  p_stack_measure (P_STACK (widget), SIZE_WIDTH, -1,
+                   minimum_width, natural_width);
+}
+
 static void
 p_stack_get_preferred_width_for_height (GtkWidget *widget,
                                           gint       height,
                                           gint      *minimum_width,
                                           gint      *natural_width)
 {
-  PStack *stack = P_STACK (widget);
-  PStackPrivate *priv = stack->priv;
-  PStackChildInfo *child_info;
-  GtkWidget *child;
-  gint child_min, child_nat;
-  GList *l;
-
-  *minimum_width = 0;
-  *natural_width = 0;
-
-  for (l = priv->children; l != NULL; l = l->next)
-    {
-      child_info = l->data;
-      child = child_info->widget;
-
-      if (!priv->homogeneous &&
-          (priv->visible_child != child_info &&
-           priv->last_visible_child != child_info))
-        continue;
-      if (gtk_widget_get_visible (child))
-        {
-          gtk_widget_get_preferred_width_for_height (child, height, &child_min, &child_nat);
-
-          *minimum_width = MAX (*minimum_width, child_min);
-          *natural_width = MAX (*natural_width, child_nat);
-        }
-    }
-
-  if (priv->last_visible_surface != NULL)
-    {
-      *minimum_width = MAX (*minimum_width, priv->last_visible_surface_allocation.width);
-      *natural_width = MAX (*natural_width, priv->last_visible_surface_allocation.width);
-    }
+  p_stack_measure (P_STACK (widget), SIZE_WIDTH_FOR_HEIGHT, height,
+                   minimum_width, natural_width);
 }
@@ -49,6 +49,10 @@ typedef enum {
   P_STACK_TRANSITION_TYPE_SLIDE_DOWN
 } PStackTransitionType;
 
+typedef GtkWidget * (*PStackPageFactory) (PStack      *stack,
+                                          const gchar *name,
+                                          gpointer     user_data);
+
 struct _PStack {
   GtkContainer parent_instance;
   PStackPrivate *priv;
@@ -68,6 +72,15 @@ void                   p_stack_add_titled              (PStack               *st
                                                         GtkWidget            *child,
                                                         const gchar          *name,
                                                         const gchar          *title);
+void                   p_stack_add_lazy                (PStack               *stack,
+                                                        const gchar          *name,
+                                                        const gchar          *title,
+                                                        PStackPageFactory     factory,
+                                                        gpointer              factory_target,
+                                                        GDestroyNotify        factory_target_destroy_notify);
+void                   p_stack_set_unload_policy       (PStack               *stack,
+                                                        guint                 timeout,
+                                                        guint                 max_hidden_pages);
 void                   p_stack_set_visible_child       (PStack               *stack,
                                                         GtkWidget            *child);
 GtkWidget *            p_stack_get_visible_child       (PStack               *stack);
@@ -77,6 +90,14 @@ const gchar *          p_stack_get_visible_child_name  (PStack               *st
 void                   p_stack_set_visible_child_full  (PStack               *stack,
                                                         const gchar          *name,
                                                         PStackTransitionType  transition);
+void                   p_stack_prewarm_child           (PStack               *stack,
+                                                        GtkWidget            *child);
+void                   p_stack_prewarm_child_name      (PStack               *stack,
+                                                        const gchar          *name);
+void                   p_stack_set_prewarm_adjacent    (PStack               *stack,
+                                                        gboolean              prewarm_adjacent);
+void                   p_stack_set_snapshot_cache_size (PStack               *stack,
+                                                        gsize                 size);
 void                   p_stack_set_homogeneous         (PStack               *stack,
                                                         gboolean              homogeneous);
 gboolean               p_stack_get_homogeneous         (PStack               *stack);